@@ -0,0 +1,134 @@
+/*
+counters.c - Hardware performance counters of the calling thread.
+See counters.h for the interface.
+*/
+
+#define _GNU_SOURCE
+
+#include "counters.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+	const char *name;
+} events[COUNTER_COUNT] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch_misses" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "llc_misses" },
+};
+
+// Once perf events are refused, no thread tries again.
+static int denied;
+static int warned;
+
+// The calling thread's group: 0 until opened, then 1, or -1 if nothing opened.
+static __thread int state;
+static __thread int fds[COUNTER_COUNT];
+static __thread int slots[COUNTER_COUNT];	// where each counter is in a group read, -1 if not open
+static __thread int members;
+
+static void warn( int counter, int err )
+{
+	if (__sync_bool_compare_and_swap(&warned, 0, 1))
+		fprintf(stderr, "hardware counters: cannot count %s: %s\n", events[counter].name, strerror(err));
+}
+
+static void open_group()
+{
+	int leader = -1;
+
+	state = -1;
+	members = 0;
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		fds[i] = -1;
+		slots[i] = -1;
+	}
+	if (denied)
+		return;
+
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		struct perf_event_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[i].type;
+		attr.config = events[i].config;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+		if (fds[i] < 0) {
+			// Without permission or support, no other counter will open either.
+			if (errno == EACCES || errno == EPERM || errno == ENOSYS)
+				denied = 1;
+			warn(i, errno);
+			if (denied)
+				break;
+			continue;
+		}
+		if (leader < 0)
+			leader = fds[i];
+		slots[i] = members++;
+	}
+
+	// Without even one hardware counter, the cpu has none to offer.
+	if (members)
+		state = 1;
+	else
+		denied = 1;
+}
+
+int counters_read( long long values[COUNTER_COUNT] )
+{
+	uint64_t buf[3 + COUNTER_COUNT];
+
+	for (int i = 0; i < COUNTER_COUNT; i++)
+		values[i] = -1;
+
+	if (!state)
+		open_group();
+	if (state < 0)
+		return 0;
+
+	int leader = -1;
+	for (int i = 0; i < COUNTER_COUNT && leader < 0; i++)
+		leader = slots[i] >= 0 ? fds[i] : -1;
+	if (read(leader, buf, (3 + members) * sizeof(uint64_t)) < (ssize_t)((3 + members) * sizeof(uint64_t)))
+		return 0;
+
+	// Scale up the counts of a group the kernel had to share the counters with.
+	uint64_t enabled = buf[1], running = buf[2];
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		if (slots[i] < 0)
+			continue;
+		uint64_t count = buf[3 + slots[i]];
+		values[i] = running && running < enabled ? (long long)((double)count * enabled / running) : (long long)count;
+	}
+	return 1;
+}
+
+void counters_close()
+{
+	if (state > 0) {
+		for (int i = 0; i < COUNTER_COUNT; i++) {
+			if (fds[i] >= 0)
+				close(fds[i]);
+		}
+	}
+	state = 0;
+}
+
+const char *counter_name( int counter )
+{
+	return counter >= 0 && counter < COUNTER_COUNT ? events[counter].name : "unknown";
+}
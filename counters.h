@@ -0,0 +1,30 @@
+/*
+counters.h - Hardware performance counters of the calling thread.
+
+Each thread that asks opens one perf_event_open group counting the
+COUNTER_ events of render.h in user space, and keeps it until it
+calls counters_close.  Reading the group is one system call, cheap
+enough to do around every tile.  Where the kernel does not permit
+perf events, or the cpu lacks one, those counters read as -1 and a
+single warning is printed, and rendering goes on without them.
+*/
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include "render.h"
+
+/*
+Set values to the running totals of the calling thread's counters,
+opening them on first use, with -1 for those not available.  Return
+0 if none are.
+*/
+int counters_read( long long values[COUNTER_COUNT] );
+
+/* Close the calling thread's counters, before it exits. */
+void counters_close();
+
+/* The name of a COUNTER_, as reports print it. */
+const char *counter_name( int counter );
+
+#endif
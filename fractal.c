@@ -1,32 +1,28 @@
 /*
 fractal.c - Sample Mandelbrot Fractal Display
 Starting code for CSE 30341 Project 3.
+
+Every engine of render.h can draw the view, picked with -s or
+switched with a key while it runs, so engines can be compared on
+the same viewport.  fractalthread and fractaltask are this program
+built to start on the band and tile engines.
 */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "gfx.h"
+#include "render.h"
+#include "stats.h"
+#include "governor.h"
+#include "trace.h"
+#include "preview.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <errno.h>
 #include <string.h>
-#include <complex.h>
-
-/*
-Compute the number of iterations at point x, y
-in the complex space, up to a maximum of maxiter.
-Return the number of iterations at that point.
-
-This example computes the Mandelbrot fractal:
-z = z^2 + alpha
-
-Where z is initially zero, and alpha is the location x + iy
-in the complex plane.  Note that we are using the "complex"
-numeric type in C, which has the special functions cabs()
-and cpow() to compute the absolute values and powers of
-complex values.
-*/
-
+#include <unistd.h>
 
 #define XMIN -1.5
 #define XMAX 0.5
@@ -34,69 +30,99 @@ complex values.
 #define YMAX 1.0
 #define MAXITER 500
 
+// The engine to start with; the Makefile sets it for fractalthread and fractaltask.
+#ifndef SCHEDULE
+#define SCHEDULE SCHED_SERIAL
+#endif
+
 // The initial boundaries of the fractal image in x,y space.
 double xmin = XMIN;
 double xmax = XMAX;
 double ymin = YMIN;
 double ymax = YMAX;
 
-static int compute_point( double x, double y, int max )
-{
-	double complex z = 0;
-	double complex alpha = x + I*y;
+// How the image is split between threads, one of the SCHED_ engines.
+int schedule = SCHEDULE;
+int block_rows = BLOCK_ROWS;
+int tile_size = TASK_SIZE;
 
-	int iter = 0;
+// Pin each thread to its own cpu, node by node.
+int pin = 0;
 
-	while( cabs(z)<4 && iter < max ) {
-		z = cpow(z,2) + alpha;
-		iter++;
-	}
+render_buffer buffer;
 
-	return iter;
-}
+// Worker threads kept between frames, shared with the Julia preview.
+render_pool *pool;
+
+// Show the Julia set for the point under the pointer in the corner.
+int show_preview = 0;
+julia_preview preview;
+
+// Draw through the shared-memory framebuffer when the display allows it.
+int use_fb = 1;
+
+// Extra samples for pixels on edges, 0 to turn antialiasing off.
+int aa_samples = 0;
+
+// Color by estimated distance to the set, which draws the boundary crisply.
+int distance = 0;
+
+// Spread the colors evenly over the pixels by the histogram of their iterations.
+int equalize = 0;
+
+// Pick each frame's maxiter from how the pixels of the one before escaped.
+int auto_depth = 0;
+
+// With a budget, frames drawn while navigating drop quality to finish within it.
+double budget_ms = 0;
+governor gov;
+
+// Which fractal to draw: the family, the power n in z^n, and the Julia parameter.
+int fractal = FRACTAL_MANDELBROT;
+int power = 2;
+double kx = JULIA_KX;
+double ky = JULIA_KY;
+
+// Per-frame measurements and where to report them.
+frame_stats stats;
+stats_output output;
+
+// When and where each tile was computed, for chrome://tracing, or NULL.
+render_trace *trace;
 
 /*
 Compute an entire image, writing each point to the given bitmap.
 Scale the image to the range (xmin-xmax,ymin-ymax).
 */
 
-void compute_image( double xmin, double xmax, double ymin, double ymax, int maxiter )
+void compute_image(int num_threads, double xmin, double xmax, double ymin, double ymax, int maxiter, int interactive )
 {
-	int i,j;
-
-	int width = gfx_xsize();
-	int height = gfx_ysize();
-
-	// For every pixel i,j, in the image...
-
-	for(j=0;j<height;j++) {
-		for(i=0;i<width;i++) {
-
-			// Scale from pixels i,j to coordinates x,y
-			double x = xmin + i*(xmax-xmin)/width;
-			double y = ymin + j*(ymax-ymin)/height;
-
-			// Compute the iterations at x,y
-			int iter = compute_point(x,y,maxiter);
-
-			// Convert a iteration number to an RGB color.
-            // Map the iteration count to a color gradient
-			/* Extra Credit Part */
-    		int r, g, b;
-    		if (iter == maxiter) {
-        		r = g = b = 0;
-   		 	} else {
-        		double t = (double)iter / (double)maxiter;
-        		r = (int)(9*(1-t)*t*t*t*255);
-        		g = (int)(15*(1-t)*(1-t)*t*t*255);
-        		b = (int)(8.5*(1-t)*(1-t)*(1-t)*t*255);
-    		}
-    		gfx_color(r, g, b);
-
-			// Plot the point on the screen.
-			gfx_point(i,j);
-		}
-	}
+	viewport v = { xmin, xmax, ymin, ymax, gfx_xsize(), gfx_ysize(), maxiter, fractal, power, kx, ky };
+	render_opts opts;
+
+	render_opts_init(&opts, schedule, num_threads);
+	opts.block_rows = block_rows;
+	opts.tile_size = tile_size;
+	opts.pin = pin;
+
+	opts.aa_samples = aa_samples;
+	opts.distance = distance;
+	opts.equalize = equalize;
+	opts.stats = &stats;
+	opts.trace = trace;
+	opts.pool = pool;
+	if (show_preview)
+		opts.num_threads -= preview_reserve(num_threads);
+
+	if (budget_ms > 0)
+		governor_window(&gov, &v, &opts, interactive, &buffer, use_fb);
+	else
+		render_window(&v, &opts, &buffer, use_fb);
+
+	stats_report(&output, &stats);
+
+	if (show_preview)
+		preview_show(&preview, &buffer, use_fb);
 }
 
 // Zoom in function
@@ -169,37 +195,167 @@ void print_coord() {
 	printf("coordinates: %lf %lf %lf %lf\n",xmin,xmax,ymin,ymax);
 }
 
+// The maxiter for the frame after the one just drawn.
+int next_maxiter( int maxiter ) {
+	// A frame the governor rendered shallower cannot tell how deep the view needs.
+	if (!auto_depth || (budget_ms > 0 && governor_shallow(&gov)))
+		return maxiter;
+	int next = render_auto_maxiter(&stats);
+	if (next != maxiter)
+		printf("maxiter: %d\n", next);
+	return next;
+}
+
+void print_fractal() {
+	if (fractal == FRACTAL_JULIA)
+		printf("fractal: %s power %d k %lf %lf\n",fractal_name(fractal),power,kx,ky);
+	else
+		printf("fractal: %s power %d\n",fractal_name(fractal),power);
+}
+
+// Preview the Julia set of the point under the pointer.
+void request_preview( int num_threads, int maxiter ) {
+	double x = xmin + (xmax - xmin) * gfx_xpos() / gfx_xsize();
+	double y = ymin + (ymax - ymin) * gfx_ypos() / gfx_ysize();
+	preview_request(&preview, x, y, power, maxiter, num_threads);
+}
+
+// Make the point under the pointer the Julia parameter.
+void pick_julia() {
+	kx = xmin + (xmax - xmin) * gfx_xpos() / gfx_xsize();
+	ky = ymin + (ymax - ymin) * gfx_ypos() / gfx_ysize();
+	print_fractal();
+}
+
+void print_threads( int num_threads ) {
+	printf("threads: %d%s\n",num_threads,pin ? " pinned" : "");
+}
+
+void print_schedule() {
+	if (schedule == SCHED_CYCLIC)
+		printf("schedule: %s block rows: %d\n",schedule_name(schedule),block_rows);
+	else if (schedule == SCHED_TILE)
+		printf("schedule: %s tile size: %d\n",schedule_name(schedule),tile_size);
+	else
+		printf("schedule: %s\n",schedule_name(schedule));
+}
+
+void usage( const char *prog ) {
+	fprintf(stderr,"usage: %s [-n threads] [-p] [-s serial|band|cyclic|tile] [-r block rows] [-t tile size] [-v] [-l stats.csv|stats.json] [-T trace.json] [-A samples] [-D] [-H] [-Z] [-B budget ms] [-F fractal] [-N power] [-K kx,ky]\n",prog);
+	exit(1);
+}
+
 int main( int argc, char *argv[] )
 {
-
+	// Default to one thread per cpu we are allowed to use.
+	int num_threads = render_default_threads();
 	// Maximum number of iterations to compute.
 	// Higher values take longer but have more detail.
 	int maxiter = MAXITER;
 
+	int c;
+	while ((c = getopt(argc, argv, "n:ps:r:t:vl:A:DHZB:F:N:K:T:")) != -1) {
+		switch (c) {
+			case 'n':
+				num_threads = atoi(optarg);
+				break;
+			case 'p':
+				pin = 1;
+				break;
+			case 'v':
+				output.verbose = 1;
+				break;
+			case 'l':
+				stats_log_open(&output, optarg);
+				break;
+			case 'T':
+				trace = trace_open(optarg);
+				break;
+			case 'A':
+				aa_samples = atoi(optarg);
+				if (aa_samples < 0 || aa_samples > AA_MAX_SAMPLES)
+					usage(argv[0]);
+				break;
+			case 'D':
+				distance = 1;
+				break;
+			case 'H':
+				equalize = 1;
+				break;
+			case 'Z':
+				auto_depth = 1;
+				break;
+			case 'B':
+				budget_ms = atof(optarg);
+				if (budget_ms <= 0)
+					usage(argv[0]);
+				break;
+			case 'F':
+				fractal = fractal_parse(optarg);
+				if (fractal < 0)
+					usage(argv[0]);
+				break;
+			case 'N':
+				power = atoi(optarg);
+				if (power < 2 || power > MAX_POWER)
+					usage(argv[0]);
+				break;
+			case 'K':
+				if (sscanf(optarg, "%lf,%lf", &kx, &ky) != 2)
+					usage(argv[0]);
+				break;
+			case 's':
+				schedule = schedule_parse(optarg);
+				if (schedule < 0)
+					usage(argv[0]);
+				break;
+			case 'r':
+				block_rows = atoi(optarg);
+				break;
+			case 't':
+				tile_size = atoi(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (num_threads < 1 || num_threads > MAX_THREADS || block_rows < 1 || tile_size < 1)
+		usage(argv[0]);
+
+	governor_init(&gov, budget_ms / 1000);
+
 	// Open a new window.
 	gfx_open(640,480,"Mandelbrot Fractal");
 
+	pool = render_pool_create();
+	preview.verbose = output.verbose;
+	preview_start(&preview, pool);
+
 	// Show the configuration, just in case you want to recreate it.
 	printf("coordinates: %lf %lf %lf %lf\n",xmin,xmax,ymin,ymax);
+	print_schedule();
 
 	// Fill it with a dark blue initially.
 	gfx_clear_color(0,0,255);
 	gfx_clear();
 
-	// Display the fractal image
-	compute_image(xmin,xmax,ymin,ymax,maxiter);
+	int key = 0;
+	// Display the fractal image2
+	compute_image(num_threads, xmin, xmax, ymin, ymax, maxiter, 0);
+	maxiter = next_maxiter(maxiter);
+	
 	gfx_flush();
 
-	char key = 0;
 	while(1) {
-		/*// Wait for a key or mouse click.
-		int c = gfx_wait();
+	/*// Wait for a key or mouse click.
+	int c = gfx_wait();
 
-		// Quit if q is pressed.
-		if(c=='q') exit(0);*/
+	// Quit if q is pressed.
+	if(c=='q') exit(0);*/
 
-		if (gfx_event_waiting()) {
-			key = gfx_wait();
+		// Sleep until a key, a click or a resize, so an idle viewer uses no cpu.
+		key = gfx_wait_timeout(budget_ms > 0 && governor_pending(&gov) ? GOVERNOR_IDLE_MS : -1, show_preview ? preview.fd : -1);
+		if (key != GFX_TIMEOUT) {
 			switch (key) {
 				// 'i' to zoom in
 				case 'i':
@@ -226,7 +382,7 @@ int main( int argc, char *argv[] )
 					move_left();
 					print_coord();
 					break;
-				// 'd' to move right
+					// 'd' to move right
 				case 'd':
 					move_right();
 					print_coord();
@@ -238,7 +394,8 @@ int main( int argc, char *argv[] )
                 	break;
 				// '-' decrease maxiter
 				case '-':
-					maxiter /= 2;
+					if (maxiter > 1)
+						maxiter /= 2;
 					print_coord();
                 	break;
 				// 'x' to reset
@@ -248,28 +405,177 @@ int main( int argc, char *argv[] )
                 	ymin = YMIN;
                 	ymax = YMAX;
                 	maxiter = MAXITER;
-                	compute_image(xmin, xmax, ymin, ymax, maxiter);
-					printf("coordinates: %lf %lf %lf %lf\n",xmin,xmax,ymin,ymax);
+                	compute_image(num_threads, xmin, xmax, ymin, ymax, maxiter, 0);
+                	maxiter = next_maxiter(maxiter);
+					print_coord();
                 	break;
 				// mouse click
 				case 1:
-					recenter_location();
+					if (show_preview)
+						pick_julia();
+					else
+						recenter_location();
 					break;
 				case 2:
-					recenter_location();
+					if (show_preview)
+						pick_julia();
+					else
+						recenter_location();
 					break;
 				case 3:
-					recenter_location();
+					if (show_preview)
+						pick_julia();
+					else
+						recenter_location();
+					break;
+				// change number of threads
+				case '1':
+					num_threads = 1;
+					break;
+				case '2':
+					num_threads = 2;
+					break;
+				case '3':
+					num_threads = 3;
+					break;
+				case '4':
+					num_threads = 4;
+					break;
+				case '5':
+					num_threads = 5;
+					break;
+				case '6':
+					num_threads = 6;
+					break;
+				case '7':
+					num_threads = 7;
+					break;
+				case '8':
+					num_threads = 8;
+					break;
+				// '0' for one thread per cpu, ',' and '.' to halve or double
+				case '0':
+					num_threads = render_default_threads();
+					print_threads(num_threads);
+					break;
+				case ',':
+					if (num_threads > 1)
+						num_threads /= 2;
+					print_threads(num_threads);
+					break;
+				case '.':
+					if (num_threads * 2 <= MAX_THREADS)
+						num_threads *= 2;
+					print_threads(num_threads);
+					break;
+				// 'p' to toggle pinning threads to cpus
+				case 'p':
+					pin = !pin;
+					print_threads(num_threads);
+					break;
+				// 'u', 'b', 'c' and 't' switch to the serial, band, cyclic and tile engines
+				case 'u':
+					schedule = SCHED_SERIAL;
+					print_schedule();
+					break;
+				case 'b':
+					schedule = SCHED_BAND;
+					print_schedule();
+					break;
+				case 'c':
+					schedule = SCHED_CYCLIC;
+					print_schedule();
+					break;
+				case 't':
+					schedule = SCHED_TILE;
+					print_schedule();
+					break;
+				// '[' and ']' halve or double the cyclic block size or the tile size
+				case '[':
+					if (schedule == SCHED_TILE && tile_size > 1)
+						tile_size /= 2;
+					else if (schedule != SCHED_TILE && block_rows > 1)
+						block_rows /= 2;
+					print_schedule();
+					break;
+				case ']':
+					if (schedule == SCHED_TILE && tile_size < gfx_xsize() && tile_size < gfx_ysize())
+						tile_size *= 2;
+					else if (schedule != SCHED_TILE && block_rows < gfx_ysize())
+						block_rows *= 2;
+					print_schedule();
+					break;
+				// 'f' to toggle drawing through the framebuffer
+				case 'f':
+					use_fb = !use_fb;
+					printf("framebuffer: %s\n", !use_fb ? "off" : gfx_fb_shared() ? "shared memory" : "on");
+					break;
+				// 'm' to toggle adaptive supersampling of edges
+				case 'm':
+					aa_samples = aa_samples ? 0 : AA_SAMPLES;
+					printf("antialiasing: %d extra samples on edges\n", aa_samples);
+					break;
+				// 'e' to toggle coloring by estimated distance
+				case 'e':
+					distance = !distance;
+					printf("distance estimation: %s\n", distance ? "on" : "off");
+					break;
+				// 'h' to toggle histogram equalized colors
+				case 'h':
+					equalize = !equalize;
+					printf("histogram coloring: %s\n", equalize ? "on" : "off");
+					break;
+				// 'z' to toggle picking maxiter automatically
+				case 'z':
+					auto_depth = !auto_depth;
+					printf("automatic depth: %s\n", auto_depth ? "on" : "off");
+					maxiter = next_maxiter(maxiter);
+					break;
+				// 'g' to cycle through the fractal families, 'n' through the powers
+				case 'g':
+					fractal = (fractal + 1) % FRACTAL_COUNT;
+					print_fractal();
+					break;
+				case 'n':
+					power = power < MAX_POWER ? power + 1 : 2;
+					print_fractal();
+					break;
+				// 'j' to toggle the Julia preview; clicks then pick the Julia parameter
+				case 'j':
+					show_preview = !show_preview;
+					gfx_motion(show_preview);
+					printf("julia preview: %s\n", show_preview ? "on" : "off");
+					break;
+				case GFX_MOTION:
+					request_preview(num_threads, maxiter);
+					break;
+				case GFX_FD_READY:
+					preview_show(&preview, &buffer, use_fb);
+					break;
+				// 'v' to toggle the per-thread stats overlay
+				case 'v':
+					output.overlay = !output.overlay;
 					break;
 				case 'q':
-					return EXIT_SUCCESS;
+					preview_stop(&preview);
+					render_pool_free(pool);
+					trace_close(trace);
+					stats_log_close(&output);
+                	return EXIT_SUCCESS;
             	default:
                 	break;
 			}
-			if (key == 'i' || key == 'o' || key == 'w' || key == 's' || key == 'a' || key == 'd' || key == '+' || key == '-' || key == 1 || key == 2 || key == 3) {
+			if (key == 'i' || key == 'o' || key == 'w' || key == 's' || key == 'a' || key == 'd' || key == '+' || key == '-' || ((key == 1 || key == 2 || key == 3) && (!show_preview || fractal == FRACTAL_JULIA)) || key == 'j' || key == 'v' || key == 'f' || key == 'm' || key == 'e' || key == 'h' || key == 'z' || key == 'g' || key == 'n' || key == 'u' || key == 'b' || key == 'c' || key == 't' || key == '[' || key == ']' || key == GFX_RESIZE) {
 				gfx_clear();
-            	compute_image(xmin, xmax, ymin, ymax, maxiter);
+            	compute_image(num_threads, xmin, xmax, ymin, ymax, maxiter, 1);
+            	maxiter = next_maxiter(maxiter);
+				if (show_preview)
+					request_preview(num_threads, maxiter);
 			}
+		} else if (governor_pending(&gov)) {
+			// Input has paused: refine the last frame to full quality.
+			compute_image(num_threads, xmin, xmax, ymin, ymax, maxiter, 0);
+			maxiter = next_maxiter(maxiter);
 		}
 	}
 
@@ -0,0 +1,1203 @@
+/*
+fractalbench.c - Reproducible render benchmark, without a window.
+
+Renders a fixed set of viewports at several resolutions through
+every engine (serial, band, cyclic and tile) and thread count, and
+prints the median, mean and variance of the run times as CSV or JSON.
+
+With -c it instead checks that every engine and option produces the
+same iteration buffer as the serial engine, or as the golden buffers
+stored in the directory given with -g (written there with -u), for
+each fractal family and, comparing colors, with antialiasing, distance
+estimation and histogram equalization.  make check runs it against
+the buffers in golden/.
+
+With -T it measures the tile codec of tilecodec.h on each view
+instead: the bits it spends per count and how fast it encodes and
+decodes, checking that every tile decodes back exactly.
+
+With -G it replays a scripted navigation through each view with the
+frame governor of governor.h holding frames to the budget given, and
+fails if more than GOVERNOR_MISSES of them run over.  With -Z as well,
+maxiter follows render_auto_maxiter from frame to frame, as in the
+viewers.  The same navigation is then replayed at full depth on a
+small image, and the check also fails if the governor's frames took
+maxiter more than GOVERNOR_DRIFT times below the lowest it reached.
+With -D the frames are rendered in distance mode.
+
+With -E the hardware counters of counters.h are read around every
+tile, and each result gets their mean per frame, followed by their
+totals for each kernel variant: precision and distance estimation.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "render.h"
+#include "stats.h"
+#include "tilecodec.h"
+#include "governor.h"
+#include "counters.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LIST 32
+#define GOLDEN_MAGIC "fractalgolden"
+#define CODEC_TILE 64	// the tile size of fractalserver
+#define GOVERNOR_MISSES 0.05	// the fraction of -G frames that may run over budget
+#define GOVERNOR_DRIFT 2	// how far below the full depth run -G -Z may take maxiter
+#define GOVERNOR_REF_SHIFT 2	// the full depth run is this many halvings smaller
+
+/*
+A canonical view.  The y span follows the aspect ratio of the
+image, except for "default", which is stretched exactly like the
+first frame of the viewers.
+*/
+typedef struct {
+	const char *name;
+	double xcenter;
+	double ycenter;
+	double xspan;
+	double yspan;	// 0 to follow the aspect ratio
+	int maxiter;
+} bench_view;
+
+static const bench_view views[] = {
+	{ "default",   -0.5,                0.0,               2.0,  2.0, 500 },
+	{ "seahorse",  -0.7453,             0.1127,            0.01, 0,   1000 },
+	{ "deep",      -0.743643887037151,  0.131825904205330, 5e-9, 0,   4000 },
+	{ "interior",  -0.1,                0.0,               0.2,  0,   500 },
+};
+static const int num_views = sizeof(views) / sizeof(views[0]);
+
+// With -l, every run is measured and logged.
+frame_stats stats;
+stats_output output;
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_double( const void *a, const void *b )
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* Parse a comma separated list of positive ints, such as "1,4,16". */
+
+static int parse_ints( const char *arg, int *list )
+{
+	int n = 0;
+	const char *p = arg;
+
+	while (*p && n < MAX_LIST) {
+		char *end;
+		list[n++] = strtol(p, &end, 10);
+		if (end == p || list[n-1] < 1)
+			return 0;
+		if (*end != ',')
+			break;
+		p = end + 1;
+	}
+	return n;
+}
+
+/* Parse a list of sizes, such as "320x240,640x480". */
+
+static int parse_sizes( const char *arg, int *widths, int *heights )
+{
+	int n = 0;
+	const char *p = arg;
+
+	while (*p && n < MAX_LIST) {
+		if (sscanf(p, "%dx%d", &widths[n], &heights[n]) != 2 || widths[n] < 1 || heights[n] < 1)
+			return 0;
+		n++;
+		p = strchr(p, ',');
+		if (!p)
+			break;
+		p++;
+	}
+	return n;
+}
+
+/* Parse a list of names into flags, for -V and -e. */
+
+static int parse_names( const char *arg, int *use, int count, const char *(*name_of)( int ) )
+{
+	char *list = strdup(arg);
+	int ok = 1;
+
+	memset(use, 0, count * sizeof(int));
+	for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+		int found = -1;
+		for (int i = 0; i < count; i++) {
+			if (!strcmp(name, name_of(i)))
+				found = i;
+		}
+		if (found < 0)
+			ok = 0;
+		else
+			use[found] = 1;
+	}
+
+	free(list);
+	return ok;
+}
+
+static const char *view_name( int i )
+{
+	return views[i].name;
+}
+
+// The fractal every view is drawn in, from -F, -N and -K.
+static int fractal = FRACTAL_MANDELBROT;
+static int power = 2;
+static double kx = JULIA_KX;
+static double ky = JULIA_KY;
+
+static void view_at( const bench_view *bv, int width, int height, viewport *v )
+{
+	double yspan = bv->yspan > 0 ? bv->yspan : bv->xspan * height / width;
+
+	v->xmin = bv->xcenter - bv->xspan / 2;
+	v->xmax = bv->xcenter + bv->xspan / 2;
+	v->ymin = bv->ycenter - yspan / 2;
+	v->ymax = bv->ycenter + yspan / 2;
+	v->width = width;
+	v->height = height;
+	v->maxiter = bv->maxiter;
+	v->fractal = fractal;
+	v->power = power;
+	v->kx = kx;
+	v->ky = ky;
+}
+
+/* Summary of the run times of one configuration, in seconds. */
+typedef struct {
+	double median;
+	double mean;
+	double variance;
+	double min;
+	double max;
+	long long iters;
+	long long counters[COUNTER_COUNT];	/* per frame, -1 if not counted */
+} bench_result;
+
+/* The counters summed over every frame that ran each kernel variant, for -E. */
+typedef struct {
+	long frames;
+	long long iters;
+	long long counters[COUNTER_COUNT];
+} kernel_total;
+
+static kernel_total kernel_totals[PREC_COUNT][2];	// by precision, and with distances
+
+/*
+Render v reps times after one untimed warm-up run,
+and summarize the run times.
+*/
+
+static void run( const viewport *v, render_opts *o, render_buffer *buffer, int reps, bench_result *res )
+{
+	double times[reps];
+	unsigned int *colors = NULL;
+	float *dist = NULL;
+
+	o->stats = output.log || o->counters ? &stats : NULL;
+	int *iters = render_buffer_get(buffer, v, o);
+
+	// Antialiasing and equalizing work on colors, so with -A or -H the colors are computed too.
+	if (o->aa_samples || o->equalize) {
+		colors = malloc((size_t)v->width * v->height * sizeof(unsigned int));
+		if (!colors) {
+			perror("malloc");
+			exit(1);
+		}
+	}
+	if (o->distance) {
+		dist = malloc((size_t)v->width * v->height * sizeof(float));
+		if (!dist) {
+			perror("malloc");
+			exit(1);
+		}
+	}
+
+	render_image(v, o, iters, dist, colors, NULL, NULL);
+
+	for (int c = 0; c < COUNTER_COUNT; c++)
+		res->counters[c] = o->counters ? 0 : -1;
+
+	for (int r = 0; r < reps; r++) {
+		double start = now();
+		render_image(v, o, iters, dist, colors, NULL, NULL);
+		times[r] = now() - start;
+		if (output.log)
+			stats_report(&output, o->stats);
+
+		if (o->counters) {
+			kernel_total *k = &kernel_totals[stats.precision][o->distance ? 1 : 0];
+			k->frames++;
+			k->iters += stats.iters;
+			for (int c = 0; c < COUNTER_COUNT; c++) {
+				if (stats.counters[c] < 0 || res->counters[c] < 0)
+					res->counters[c] = -1;
+				else
+					res->counters[c] += stats.counters[c];
+				if (stats.counters[c] < 0 || k->counters[c] < 0)
+					k->counters[c] = -1;
+				else
+					k->counters[c] += stats.counters[c];
+			}
+		}
+	}
+	for (int c = 0; c < COUNTER_COUNT; c++) {
+		if (res->counters[c] > 0)
+			res->counters[c] /= reps;
+	}
+	free(colors);
+	free(dist);
+
+	res->iters = 0;
+	for (size_t i = 0; i < (size_t)v->width * v->height; i++)
+		res->iters += iters[i];
+
+	qsort(times, reps, sizeof(double), compare_double);
+	res->min = times[0];
+	res->max = times[reps - 1];
+	res->median = reps % 2 ? times[reps / 2] : (times[reps / 2 - 1] + times[reps / 2]) / 2;
+
+	res->mean = 0;
+	for (int r = 0; r < reps; r++)
+		res->mean += times[r];
+	res->mean /= reps;
+
+	res->variance = 0;
+	for (int r = 0; r < reps; r++)
+		res->variance += (times[r] - res->mean) * (times[r] - res->mean);
+	res->variance = reps > 1 ? res->variance / (reps - 1) : 0;
+}
+
+/* a / b times scale, or -1 if either was not counted. */
+
+static double ratio( long long a, long long b, double scale )
+{
+	return a >= 0 && b > 0 ? (double)a / b * scale : -1;
+}
+
+/*
+For -E, the counters of each kernel variant that ran, per iteration:
+which precision was doing the work and whether distances were estimated
+decide the inner loop, whatever the view, engine or thread count.
+*/
+
+static void print_kernels( int json )
+{
+	int first = 1;
+
+	if (json)
+		printf(",\n  \"kernels\":[");
+	else
+		printf("\nfractal,power,precision,distance,frames,iters,cycles,instructions,branch_misses,llc_misses,ipc,cycles_per_iter,instructions_per_iter,branch_misses_per_miter,llc_misses_per_miter\n");
+
+	for (int p = 0; p < PREC_COUNT; p++) {
+		for (int d = 0; d < 2; d++) {
+			const kernel_total *k = &kernel_totals[p][d];
+			const long long *c = k->counters;
+			if (!k->frames)
+				continue;
+
+			if (json) {
+				printf("%s\n    {\"fractal\":\"%s\",\"power\":%d,\"precision\":\"%s\",\"distance\":%d,\"frames\":%ld,\"iters\":%lld",
+					first ? "" : ",", fractal_name(fractal), power, precision_name(p), d, k->frames, k->iters);
+				for (int i = 0; i < COUNTER_COUNT; i++)
+					printf(",\"%s\":%lld", counter_name(i), c[i]);
+				printf(",\"ipc\":%.3f,\"cycles_per_iter\":%.3f,\"instructions_per_iter\":%.3f,\"branch_misses_per_miter\":%.1f,\"llc_misses_per_miter\":%.1f}",
+					ratio(c[COUNTER_INSTRUCTIONS], c[COUNTER_CYCLES], 1), ratio(c[COUNTER_CYCLES], k->iters, 1), ratio(c[COUNTER_INSTRUCTIONS], k->iters, 1),
+					ratio(c[COUNTER_BRANCH_MISSES], k->iters, 1e6), ratio(c[COUNTER_LLC_MISSES], k->iters, 1e6));
+			} else {
+				printf("%s,%d,%s,%d,%ld,%lld", fractal_name(fractal), power, precision_name(p), d, k->frames, k->iters);
+				for (int i = 0; i < COUNTER_COUNT; i++)
+					printf(",%lld", c[i]);
+				printf(",%.3f,%.3f,%.3f,%.1f,%.1f\n",
+					ratio(c[COUNTER_INSTRUCTIONS], c[COUNTER_CYCLES], 1), ratio(c[COUNTER_CYCLES], k->iters, 1), ratio(c[COUNTER_INSTRUCTIONS], k->iters, 1),
+					ratio(c[COUNTER_BRANCH_MISSES], k->iters, 1e6), ratio(c[COUNTER_LLC_MISSES], k->iters, 1e6));
+			}
+			first = 0;
+		}
+	}
+
+	if (json)
+		printf("\n  ]");
+}
+
+static void print_result( int json, int first, const char *view, const viewport *v, const render_opts *o, int reps, const bench_result *res )
+{
+	double miters = res->median > 0 ? res->iters / res->median / 1e6 : 0;
+	int block = o->schedule == SCHED_CYCLIC ? o->block_rows : o->schedule == SCHED_TILE ? o->tile_size : 0;
+
+	if (json) {
+		printf("%s\n    {\"view\":\"%s\",\"fractal\":\"%s\",\"power\":%d,\"width\":%d,\"height\":%d,\"maxiter\":%d,\"engine\":\"%s\",\"block\":%d,"
+			"\"threads\":%d,\"pinned\":%d,\"precision\":\"%s\",\"aa_samples\":%d,\"distance\":%d,\"equalize\":%d,\"reps\":%d,\"median_s\":%.6f,\"mean_s\":%.6f,\"variance_s2\":%.3e,"
+			"\"min_s\":%.6f,\"max_s\":%.6f,\"iters\":%lld,\"miter_s\":%.3f",
+			first ? "" : ",", view, fractal_name(v->fractal), v->power, v->width, v->height, v->maxiter, schedule_name(o->schedule), block,
+			o->num_threads, o->pin, precision_name(render_precision(v, o->precision)), o->aa_samples, o->distance, o->equalize, reps, res->median, res->mean, res->variance,
+			res->min, res->max, res->iters, miters);
+		if (o->counters) {
+			for (int c = 0; c < COUNTER_COUNT; c++)
+				printf(",\"%s\":%lld", counter_name(c), res->counters[c]);
+			printf(",\"ipc\":%.3f", ratio(res->counters[COUNTER_INSTRUCTIONS], res->counters[COUNTER_CYCLES], 1));
+		}
+		printf("}");
+	} else {
+		printf("%s,%s,%d,%d,%d,%d,%s,%d,%d,%d,%s,%d,%d,%d,%d,%.6f,%.6f,%.3e,%.6f,%.6f,%lld,%.3f",
+			view, fractal_name(v->fractal), v->power, v->width, v->height, v->maxiter, schedule_name(o->schedule), block,
+			o->num_threads, o->pin, precision_name(render_precision(v, o->precision)), o->aa_samples, o->distance, o->equalize, reps, res->median, res->mean, res->variance,
+			res->min, res->max, res->iters, miters);
+		if (o->counters) {
+			for (int c = 0; c < COUNTER_COUNT; c++)
+				printf(",%lld", res->counters[c]);
+			printf(",%.3f", ratio(res->counters[COUNTER_INSTRUCTIONS], res->counters[COUNTER_CYCLES], 1));
+		}
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+/*
+A golden file is a text line "fractalgolden 2 width height maxiter
+bound bytes" followed by that many bytes: the width*height values of
+the buffer, iteration counts or colors, encoded as tilecodec.h
+describes with bound, their largest, in place of maxiter.
+*/
+
+static int write_golden( const char *path, const viewport *v, const int *values )
+{
+	int n = v->width * v->height;
+	int bound = 0;
+
+	for (int i = 0; i < n; i++) {
+		if (values[i] > bound)
+			bound = values[i];
+	}
+
+	unsigned char *packed = malloc(tile_encode_bound(n, bound));
+	if (!packed) {
+		perror("malloc");
+		exit(1);
+	}
+	size_t bytes = tile_encode(values, n, bound, packed);
+
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		free(packed);
+		return 0;
+	}
+	fprintf(file, "%s 2 %d %d %d %d %zu\n", GOLDEN_MAGIC, v->width, v->height, v->maxiter, bound, bytes);
+	fwrite(packed, 1, bytes, file);
+	free(packed);
+
+	return !fclose(file);
+}
+
+static int read_golden( const char *path, const viewport *v, int *values )
+{
+	int version, width, height, maxiter, bound;
+	size_t bytes;
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return 0;
+
+	if (fscanf(file, GOLDEN_MAGIC " %d %d %d %d %d %zu", &version, &width, &height, &maxiter, &bound, &bytes) != 6 ||
+	    fgetc(file) != '\n' || version != 2 || width != v->width || height != v->height || maxiter != v->maxiter || bound < 0) {
+		fprintf(stderr, "%s: not a golden buffer for this view\n", path);
+		fclose(file);
+		return 0;
+	}
+
+	unsigned char *packed = malloc(bytes ? bytes : 1);
+	if (!packed) {
+		perror("malloc");
+		exit(1);
+	}
+	int ok = fread(packed, 1, bytes, file) == bytes && !tile_decode(packed, bytes, bound, values, width * height);
+	if (!ok)
+		fprintf(stderr, "%s: does not decode\n", path);
+
+	free(packed);
+	fclose(file);
+	return ok;
+}
+
+/*
+Count the pixels whose iteration counts differ by more than
+max_diff, and return the largest difference seen in *worst.
+*/
+
+static long compare_iters( const int *a, const int *b, size_t n, int max_diff, int *worst )
+{
+	long mismatches = 0;
+
+	*worst = 0;
+	for (size_t i = 0; i < n; i++) {
+		int diff = abs(a[i] - b[i]);
+		if (diff > *worst)
+			*worst = diff;
+		if (diff > max_diff)
+			mismatches++;
+	}
+	return mismatches;
+}
+
+/*
+What -c checks on each view: the Mandelbrot set, the other families,
+and the options that change the colors rather than the counts, whose
+cases compare colors instead.  Distance mode checks the tile engine's
+disc fill, as the other engines compute every pixel.
+*/
+typedef struct {
+	const char *name;
+	int fractal;
+	int power;
+	int aa_samples;
+	int distance;
+	int equalize;
+} check_case;
+
+static const check_case cases[] = {
+	{ "mandelbrot2", FRACTAL_MANDELBROT, 2, 0, 0, 0 },
+	{ "mandelbrot3", FRACTAL_MANDELBROT, 3, 0, 0, 0 },
+	{ "julia2",      FRACTAL_JULIA,      2, 0, 0, 0 },
+	{ "ship2",       FRACTAL_SHIP,       2, 0, 0, 0 },
+	{ "tricorn2",    FRACTAL_TRICORN,    2, 0, 0, 0 },
+	{ "antialias",   FRACTAL_MANDELBROT, 2, AA_SAMPLES, 0, 0 },
+	{ "distance",    FRACTAL_MANDELBROT, 2, 0, 1, 0 },
+	{ "equalize",    FRACTAL_MANDELBROT, 2, 0, 0, 1 },
+};
+static const int num_cases = sizeof(cases) / sizeof(cases[0]);
+
+static int compares_colors( const check_case *c )
+{
+	return c->aa_samples || c->distance || c->equalize;
+}
+
+/*
+Render v with o set up for c, into a buffer of the iteration counts
+or, for a case of colors, of the colors.
+*/
+
+static void render_case( const viewport *v, render_opts *o, const check_case *c, render_buffer *buffer, int *out )
+{
+	size_t pixels = (size_t)v->width * v->height;
+
+	o->aa_samples = c->aa_samples;
+	o->distance = c->distance;
+	o->equalize = c->equalize;
+	o->stats = NULL;
+
+	int *iters = render_buffer_get(buffer, v, o);
+	if (!compares_colors(c)) {
+		render_image(v, o, iters, NULL, NULL, NULL, NULL);
+		memcpy(out, iters, pixels * sizeof(int));
+		return;
+	}
+
+	float *dist = c->distance ? malloc(pixels * sizeof(float)) : NULL;
+	if (c->distance && !dist) {
+		perror("malloc");
+		exit(1);
+	}
+	render_image(v, o, iters, dist, (unsigned int *)out, NULL, NULL);
+	free(dist);
+}
+
+/* Count the pixels whose colors differ in any channel by more than max_diff, with the largest difference in *worst. */
+
+static long compare_colors( const int *a, const int *b, size_t n, int max_diff, int *worst )
+{
+	long mismatches = 0;
+
+	*worst = 0;
+	for (size_t i = 0; i < n; i++) {
+		int diff = 0;
+		for (int shift = 0; shift < 24; shift += 8) {
+			int d = abs((a[i] >> shift & 0xff) - (b[i] >> shift & 0xff));
+			if (d > diff)
+				diff = d;
+		}
+		if (diff > *worst)
+			*worst = diff;
+		if (diff > max_diff)
+			mismatches++;
+	}
+	return mismatches;
+}
+
+/* Render case c once with o and compare against expected.  Return 1 if within tolerance. */
+
+static int check( const char *view, const viewport *v, render_opts *o, const check_case *c, render_buffer *buffer,
+	const int *expected, int *got, const char *against, long max_pixels, int max_diff )
+{
+	size_t pixels = (size_t)v->width * v->height;
+	int worst;
+
+	render_case(v, o, c, buffer, got);
+	long mismatches = compares_colors(c) ? compare_colors(expected, got, pixels, max_diff, &worst) :
+		compare_iters(expected, got, pixels, max_diff, &worst);
+	int ok = mismatches <= max_pixels;
+
+	printf("%-4s %s %s %dx%d maxiter %d: %s threads %d block %d%s %s vs %s: ",
+		ok ? "ok" : "FAIL", view, c->name, v->width, v->height, v->maxiter, schedule_name(o->schedule),
+		o->num_threads, o->schedule == SCHED_CYCLIC ? o->block_rows : o->schedule == SCHED_TILE ? o->tile_size : 0,
+		o->pin ? " pinned" : "", precision_name(render_precision(v, o->precision)), against);
+	if (mismatches || worst)
+		printf("%ld pixels differ by more than %d, max difference %d%s\n", mismatches, max_diff, worst,
+			compares_colors(c) ? " in a channel" : "");
+	else
+		printf("exact\n");
+	fflush(stdout);
+
+	return ok;
+}
+
+/*
+For each view, size and case, render the serial reference and
+compare it with the golden buffer, or write the golden buffer with
+-u.  Then check every engine, thread count, block size and pinning
+against it.  With family set, only the fractal given with -F, -N and
+-K is checked, without the color cases.  Return the exit status: 0
+if every check passed.
+*/
+
+static int run_checks( const int *use_view, const int *use_engine, const int *widths, const int *heights, int num_sizes,
+	const int *threads, int num_threads, const int *blocks, int num_blocks,
+	int precision, int family, const char *golden_dir, int update, long max_pixels, int max_diff )
+{
+	render_buffer buffer = { 0 };
+	int failures = 0;
+	check_case given = { NULL, fractal, power, 0, 0, 0 };
+	char given_name[64];
+
+	snprintf(given_name, sizeof(given_name), "%s%d", fractal_name(fractal), power);
+	given.name = given_name;
+
+	for (int vi = 0; vi < num_views; vi++) {
+		if (!use_view[vi])
+			continue;
+
+		for (int si = 0; si < num_sizes; si++) {
+			for (int ci = 0; ci < (family ? 1 : num_cases); ci++) {
+				const check_case *c = family ? &given : &cases[ci];
+				viewport v;
+				render_opts o;
+				char path[4096];
+				const char *against = "serial";
+
+				view_at(&views[vi], widths[si], heights[si], &v);
+				v.fractal = c->fractal;
+				v.power = c->power;
+
+				int *expected = malloc((size_t)v.width * v.height * sizeof(int));
+				int *got = malloc((size_t)v.width * v.height * sizeof(int));
+				if (!expected || !got) {
+					perror("malloc");
+					exit(1);
+				}
+
+				// The reference uses the engines' precision, except that float must match double exactly.
+				int reference = render_precision(&v, precision);
+				if (reference == PREC_FLOAT)
+					reference = PREC_DOUBLE;
+
+				render_opts_init(&o, SCHED_SERIAL, 1);
+				o.precision = reference;
+				render_case(&v, &o, c, &buffer, expected);
+
+				if (golden_dir) {
+					snprintf(path, sizeof(path), "%s/%s-%s-%dx%d.golden", golden_dir, views[vi].name, c->name, v.width, v.height);
+					if (update) {
+						if (!write_golden(path, &v, expected)) {
+							perror(path);
+							exit(1);
+						}
+						printf("wrote %s\n", path);
+					} else {
+						if (!read_golden(path, &v, expected)) {
+							printf("FAIL %s: cannot read golden buffer\n", path);
+							failures++;
+							free(expected);
+							free(got);
+							continue;
+						}
+						against = "golden";
+					}
+				}
+
+				for (int e = 0; e < SCHED_COUNT; e++) {
+					// Without a golden buffer the serial engine is the reference itself, unless it runs in float.
+					if (!use_engine[e] || (e == SCHED_SERIAL && strcmp(against, "golden") && render_precision(&v, precision) != PREC_FLOAT))
+						continue;
+
+					int nt = e == SCHED_SERIAL ? 1 : num_threads;
+					int nb = e == SCHED_CYCLIC ? num_blocks : 1;
+					int np = e == SCHED_SERIAL ? 1 : 2;
+
+					for (int ti = 0; ti < nt; ti++) {
+						for (int bi = 0; bi < nb; bi++) {
+							for (int pin = 0; pin < np; pin++) {
+								render_opts_init(&o, e, e == SCHED_SERIAL ? 1 : threads[ti]);
+								o.block_rows = blocks[bi];
+								o.pin = pin;
+								o.precision = precision;
+								if (!check(views[vi].name, &v, &o, c, &buffer, expected, got, against, max_pixels, max_diff))
+									failures++;
+							}
+						}
+					}
+				}
+
+				free(expected);
+				free(got);
+			}
+		}
+	}
+
+	render_buffer_free(&buffer);
+	printf("%d failures\n", failures);
+	return failures ? 1 : 0;
+}
+
+/*
+Cut each view into CODEC_TILE tiles and encode and decode them all,
+reps times, reporting the best times.
+*/
+
+static int run_codec( const int *use_view, const int *widths, const int *heights, int num_sizes, int reps, int precision )
+{
+	int failures = 0;
+
+	printf("view,width,height,maxiter,tile,bits_per_count,ratio,encode_mcount_s,decode_mcount_s\n");
+
+	for (int vi = 0; vi < num_views; vi++) {
+		if (!use_view[vi])
+			continue;
+
+		for (int si = 0; si < num_sizes; si++) {
+			viewport v;
+			render_opts o;
+			view_at(&views[vi], widths[si], heights[si], &v);
+
+			size_t pixels = (size_t)v.width * v.height;
+			int tiles_x = (v.width + CODEC_TILE - 1) / CODEC_TILE;
+			int tiles_y = (v.height + CODEC_TILE - 1) / CODEC_TILE;
+			int *iters = malloc(pixels * sizeof(int));
+			int *tiled = malloc(pixels * sizeof(int));
+			int *decoded = malloc(pixels * sizeof(int));
+			size_t bound = tile_encode_bound(CODEC_TILE * CODEC_TILE, v.maxiter);
+			unsigned char *packed = malloc(bound * tiles_x * tiles_y);
+			size_t *sizes = malloc(tiles_x * tiles_y * sizeof(size_t));
+			int *counts = malloc(tiles_x * tiles_y * sizeof(int));
+			if (!iters || !tiled || !decoded || !packed || !sizes || !counts) {
+				perror("malloc");
+				exit(1);
+			}
+
+			render_opts_init(&o, SCHED_TILE, render_default_threads());
+			o.precision = precision;
+			render_image(&v, &o, iters, NULL, NULL, NULL, NULL);
+
+			// Lay the tiles out one after another, as workers produce them.
+			int *p = tiled;
+			for (int ty = 0; ty < tiles_y; ty++) {
+				for (int tx = 0; tx < tiles_x; tx++) {
+					int w = (tx + 1) * CODEC_TILE <= v.width ? CODEC_TILE : v.width - tx * CODEC_TILE;
+					int h = (ty + 1) * CODEC_TILE <= v.height ? CODEC_TILE : v.height - ty * CODEC_TILE;
+					counts[ty * tiles_x + tx] = w * h;
+					for (int j = 0; j < h; j++) {
+						memcpy(p, iters + (size_t)(ty * CODEC_TILE + j) * v.width + tx * CODEC_TILE, w * sizeof(int));
+						p += w;
+					}
+				}
+			}
+
+			double best_encode = 0, best_decode = 0;
+			size_t total = 0;
+			for (int rep = 0; rep < reps; rep++) {
+				double start = now();
+				p = tiled;
+				total = 0;
+				for (int t = 0; t < tiles_x * tiles_y; t++) {
+					sizes[t] = tile_encode(p, counts[t], v.maxiter, packed + bound * t);
+					total += sizes[t];
+					p += counts[t];
+				}
+				double encode = now() - start;
+
+				start = now();
+				p = decoded;
+				for (int t = 0; t < tiles_x * tiles_y; t++) {
+					if (tile_decode(packed + bound * t, sizes[t], v.maxiter, p, counts[t]))
+						failures++;
+					p += counts[t];
+				}
+				double decode = now() - start;
+
+				if (rep == 0 || encode < best_encode)
+					best_encode = encode;
+				if (rep == 0 || decode < best_decode)
+					best_decode = decode;
+			}
+
+			if (memcmp(tiled, decoded, pixels * sizeof(int))) {
+				printf("FAIL %s %dx%d: tiles do not decode to what was encoded\n", views[vi].name, v.width, v.height);
+				failures++;
+			}
+
+			printf("%s,%d,%d,%d,%d,%.3f,%.2f,%.1f,%.1f\n", views[vi].name, v.width, v.height, v.maxiter, CODEC_TILE,
+				total * 8.0 / pixels, pixels * sizeof(int) / (double)total, pixels / best_encode / 1e6, pixels / best_decode / 1e6);
+
+			free(iters);
+			free(tiled);
+			free(decoded);
+			free(packed);
+			free(sizes);
+			free(counts);
+		}
+	}
+
+	return failures ? 1 : 0;
+}
+
+/*
+The navigation -G replays, each step held for frames frames: zoom
+in on the center, pan right and down, and zoom back out, as a user
+holding down the viewers' keys would.
+*/
+static const struct {
+	int key;
+	int frames;
+} script[] = {
+	{ 'i', 60 }, { 'd', 20 }, { 's', 20 }, { 'o', 60 },
+};
+
+#define SCRIPT_ZOOM 1.05	// the span shrinks or grows by this each frame
+#define SCRIPT_PAN 0.02		// and pans by this fraction of it
+
+static void script_step( viewport *v, int key )
+{
+	double xc = (v->xmin + v->xmax) / 2, yc = (v->ymin + v->ymax) / 2;
+	double xr = (v->xmax - v->xmin) / 2, yr = (v->ymax - v->ymin) / 2;
+
+	if (key == 'i' || key == 'o') {
+		double f = key == 'i' ? 1 / SCRIPT_ZOOM : SCRIPT_ZOOM;
+		xr *= f;
+		yr *= f;
+	} else if (key == 'd') {
+		xc += 2 * xr * SCRIPT_PAN;
+	} else if (key == 's') {
+		yc += 2 * yr * SCRIPT_PAN;
+	}
+	v->xmin = xc - xr;
+	v->xmax = xc + xr;
+	v->ymin = yc - yr;
+	v->ymax = yc + yr;
+}
+
+/* The maxiter auto depth gives the frame after the governor's last, which stays if it was shallow. */
+
+static int governor_depth( const governor *g, const viewport *v )
+{
+	return governor_shallow(g) ? v->maxiter : render_auto_maxiter(&g->stats);
+}
+
+/*
+Replay the script through view at full depth, on an image
+GOVERNOR_REF_SHIFT halvings smaller, with maxiter following
+render_auto_maxiter, and return the lowest it reached.
+*/
+
+static int reference_depth( const bench_view *view, int width, int height, const render_opts *o )
+{
+	viewport v;
+	render_opts ro = *o;
+	frame_stats *s = malloc(sizeof(frame_stats));
+
+	view_at(view, width, height, &v);
+	v.width = width >> GOVERNOR_REF_SHIFT > 0 ? width >> GOVERNOR_REF_SHIFT : 1;
+	v.height = height >> GOVERNOR_REF_SHIFT > 0 ? height >> GOVERNOR_REF_SHIFT : 1;
+	int *iters = malloc((size_t)v.width * v.height * sizeof(int));
+	if (!s || !iters) {
+		perror("malloc");
+		exit(1);
+	}
+	ro.aa_samples = 0;
+	ro.stats = s;
+
+	int lowest = v.maxiter;
+	for (int step = 0; step < (int)(sizeof(script) / sizeof(script[0])); step++) {
+		for (int f = 0; f < script[step].frames; f++) {
+			script_step(&v, script[step].key);
+			render_image(&v, &ro, iters, NULL, NULL, NULL, NULL);
+			v.maxiter = render_auto_maxiter(s);
+			if (v.maxiter < lowest)
+				lowest = v.maxiter;
+		}
+	}
+
+	free(iters);
+	free(s);
+	return lowest;
+}
+
+/*
+Replay the script through each view with the governor, counting the
+frames that ran over budget, then time the refinement that follows.
+With auto_depth, compare the lowest maxiter that reached with
+full depth frames along the same path.  Return the exit status: 0 if
+every view kept to the budget, and to its depth.
+*/
+
+static int run_governor( const int *use_view, const int *widths, const int *heights, int num_sizes,
+	int num_threads, double budget_ms, int precision, int aa_samples, int distance, int auto_depth )
+{
+	render_pool *pool = render_pool_create();
+	int failures = 0;
+
+	printf("view,width,height,maxiter,threads,budget_ms,frames,late,on_time,worst_ms,mean_ms,mean_level,refine_ms%s\n",
+		auto_depth ? ",lowest_maxiter,reference_maxiter" : "");
+
+	for (int vi = 0; vi < num_views; vi++) {
+		if (!use_view[vi])
+			continue;
+
+		for (int si = 0; si < num_sizes; si++) {
+			viewport v;
+			render_opts o;
+			render_buffer buffer = { 0 };
+			governor g;
+			double total = 0;
+			long levels = 0;
+			int lowest;
+
+			view_at(&views[vi], widths[si], heights[si], &v);
+			unsigned int *colors = malloc((size_t)v.width * v.height * sizeof(unsigned int));
+			if (!colors) {
+				perror("malloc");
+				exit(1);
+			}
+
+			render_opts_init(&o, SCHED_TILE, num_threads);
+			o.precision = precision;
+			o.aa_samples = aa_samples;
+			o.distance = distance;
+			o.pool = pool;
+			governor_init(&g, budget_ms / 1000);
+			lowest = v.maxiter;
+
+			for (int step = 0; step < (int)(sizeof(script) / sizeof(script[0])); step++) {
+				for (int f = 0; f < script[step].frames; f++) {
+					script_step(&v, script[step].key);
+					double start = now();
+					governor_render(&g, &v, &o, 1, &buffer, colors, NULL, NULL);
+					total += now() - start;
+					levels += g.level;
+					if (auto_depth)
+						v.maxiter = governor_depth(&g, &v);
+					if (v.maxiter < lowest)
+						lowest = v.maxiter;
+				}
+			}
+
+			double start = now();
+			governor_render(&g, &v, &o, 0, &buffer, colors, NULL, NULL);
+			double refine = now() - start;
+
+			int ok = g.late <= g.frames * GOVERNOR_MISSES;
+			int reference = 0;
+			if (auto_depth) {
+				reference = reference_depth(&views[vi], widths[si], heights[si], &o);
+				ok = ok && lowest * GOVERNOR_DRIFT >= reference;
+			}
+			if (!ok)
+				failures++;
+			printf("%s,%d,%d,%d,%d,%.1f,%ld,%ld,%.3f,%.2f,%.2f,%.2f,%.2f", views[vi].name, v.width, v.height, v.maxiter,
+				num_threads, budget_ms, g.frames, g.late, 1 - (double)g.late / g.frames, g.worst * 1000,
+				total / g.frames * 1000, (double)levels / g.frames, refine * 1000);
+			if (auto_depth)
+				printf(",%d,%d", lowest, reference);
+			printf("\n");
+			fflush(stdout);
+
+			governor_free(&g);
+			render_buffer_free(&buffer);
+			free(colors);
+		}
+	}
+
+	render_pool_free(pool);
+	if (failures)
+		printf("%d views ran over budget on more than %.0f%% of frames%s\n", failures, GOVERNOR_MISSES * 100,
+			auto_depth ? ", or below their depth" : "");
+	return failures ? 1 : 0;
+}
+
+static void usage( const char *prog )
+{
+	fprintf(stderr,"usage: %s [-V view,...] [-S WxH,...] [-e engine,...] [-n threads,...] [-b block rows,...]\n",prog);
+	fprintf(stderr,"       [-R reps] [-p] [-P precision] [-A samples] [-D] [-H]\n"
+		"       [-F fractal] [-N power] [-K kx,ky] [-j] [-l stats.csv|stats.json] [-E]\n");
+	fprintf(stderr,"       %s -c [-g golden dir [-u]] [-t pixels] [-d iterations] [view, size, engine and thread options]\n",prog);
+	fprintf(stderr,"       %s -T [-V view,...] [-S WxH,...] [-R reps] [-P precision]\n",prog);
+	fprintf(stderr,"       %s -G budget ms [-Z] [-V view,...] [-S WxH,...] [-n threads] [-P precision] [-A samples] [-D]\n",prog);
+	fprintf(stderr,"views:");
+	for (int i = 0; i < num_views; i++)
+		fprintf(stderr," %s",views[i].name);
+	fprintf(stderr,"\nengines:");
+	for (int i = 0; i < SCHED_COUNT; i++)
+		fprintf(stderr," %s",schedule_name(i));
+	fprintf(stderr,"\nfractals:");
+	for (int i = 0; i < FRACTAL_COUNT; i++)
+		fprintf(stderr," %s",fractal_name(i));
+	fprintf(stderr,"\nprecisions:");
+	for (int i = 0; i < PREC_COUNT; i++)
+		fprintf(stderr," %s",precision_name(i));
+	fprintf(stderr,"\n");
+	exit(1);
+}
+
+int main( int argc, char *argv[] )
+{
+	int widths[MAX_LIST] = { 320, 640 };
+	int heights[MAX_LIST] = { 240, 480 };
+	int num_sizes = 2;
+	int threads[MAX_LIST];
+	int num_threads = 0;
+	int blocks[MAX_LIST] = { 1, 16 };
+	int num_blocks = 2;
+	int use_view[sizeof(views) / sizeof(views[0])];
+	int use_engine[SCHED_COUNT];
+	int reps = 5;
+	int pin = 0;
+	int precision = PREC_AUTO;
+	int aa_samples = 0;
+	int distance = 0;
+	int equalize = 0;
+	int json = 0;
+	int check_mode = 0;
+	int family = 0;		// -F, -N or -K picked the fractal
+	int codec_mode = 0;
+	double budget_ms = 0;
+	int auto_depth = 0;
+	int counters = 0;
+	const char *golden_dir = NULL;
+	int update = 0;
+	long max_pixels = 0;
+	int max_diff = 0;
+	int sizes_given = 0;
+
+	for (int i = 0; i < num_views; i++)
+		use_view[i] = 1;
+	for (int i = 0; i < SCHED_COUNT; i++)
+		use_engine[i] = 1;
+
+	int c;
+	while ((c = getopt(argc, argv, "V:S:e:n:b:R:pP:A:DHF:N:K:jl:cg:ut:d:TG:ZE")) != -1) {
+		switch (c) {
+			case 'V':
+				if (!parse_names(optarg, use_view, num_views, view_name))
+					usage(argv[0]);
+				break;
+			case 'e':
+				if (!parse_names(optarg, use_engine, SCHED_COUNT, schedule_name))
+					usage(argv[0]);
+				break;
+			case 'S':
+				num_sizes = parse_sizes(optarg, widths, heights);
+				sizes_given = 1;
+				break;
+			case 'n':
+				num_threads = parse_ints(optarg, threads);
+				if (!num_threads)
+					usage(argv[0]);
+				for (int i = 0; i < num_threads; i++) {
+					if (threads[i] > MAX_THREADS)
+						usage(argv[0]);
+				}
+				break;
+			case 'b':
+				num_blocks = parse_ints(optarg, blocks);
+				break;
+			case 'R':
+				reps = atoi(optarg);
+				break;
+			case 'p':
+				pin = 1;
+				break;
+			case 'P':
+				precision = precision_parse(optarg);
+				if (precision < 0)
+					usage(argv[0]);
+				break;
+			case 'A':
+				aa_samples = atoi(optarg);
+				break;
+			case 'D':
+				distance = 1;
+				break;
+			case 'H':
+				equalize = 1;
+				break;
+			case 'F':
+				fractal = fractal_parse(optarg);
+				if (fractal < 0)
+					usage(argv[0]);
+				family = 1;
+				break;
+			case 'N':
+				power = atoi(optarg);
+				if (power < 2 || power > MAX_POWER)
+					usage(argv[0]);
+				family = 1;
+				break;
+			case 'K':
+				if (sscanf(optarg, "%lf,%lf", &kx, &ky) != 2)
+					usage(argv[0]);
+				family = 1;
+				break;
+			case 'j':
+				json = 1;
+				break;
+			case 'l':
+				stats_log_open(&output, optarg);
+				break;
+			case 'c':
+				check_mode = 1;
+				break;
+			case 'g':
+				golden_dir = optarg;
+				break;
+			case 'u':
+				update = 1;
+				break;
+			case 't':
+				max_pixels = atol(optarg);
+				break;
+			case 'd':
+				max_diff = atoi(optarg);
+				break;
+			case 'T':
+				codec_mode = 1;
+				break;
+			case 'E':
+				counters = 1;
+				break;
+			case 'Z':
+				auto_depth = 1;
+				break;
+			case 'G':
+				budget_ms = atof(optarg);
+				if (budget_ms <= 0)
+					usage(argv[0]);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (!num_sizes || !num_blocks || reps < 1 || aa_samples < 0 || aa_samples > AA_MAX_SAMPLES || max_pixels < 0 || max_diff < 0 || (update && !golden_dir))
+		usage(argv[0]);
+
+	// Checks compare every pixel, so keep the default images small.
+	if (check_mode && !sizes_given) {
+		widths[0] = 160;
+		heights[0] = 120;
+		num_sizes = 1;
+	}
+
+	// By default, thread counts double up to one per cpu, which is always included.
+	if (!num_threads) {
+		int max_threads = render_default_threads();
+		for (int n = 1; n < max_threads && num_threads < MAX_LIST - 1; n *= 2)
+			threads[num_threads++] = n;
+		threads[num_threads++] = max_threads;
+	}
+
+	if (budget_ms > 0)
+		return run_governor(use_view, widths, heights, num_sizes, threads[num_threads - 1], budget_ms, precision, aa_samples, distance, auto_depth);
+
+	if (codec_mode)
+		return run_codec(use_view, widths, heights, num_sizes, reps, precision);
+
+	if (check_mode)
+		return run_checks(use_view, use_engine, widths, heights, num_sizes, threads, num_threads, blocks, num_blocks,
+			precision, family, golden_dir, update, max_pixels, max_diff);
+
+	char host[256] = "unknown";
+	gethostname(host, sizeof(host));
+	host[sizeof(host) - 1] = 0;
+
+	if (json)
+		printf("{\n  \"host\":\"%s\",\"cpus\":%d,\n  \"results\":[", host, render_default_threads());
+	else
+		printf("view,fractal,power,width,height,maxiter,engine,block,threads,pinned,precision,aa_samples,distance,equalize,reps,median_s,mean_s,variance_s2,min_s,max_s,iters,miter_s%s\n",
+			counters ? ",cycles,instructions,branch_misses,llc_misses,ipc" : "");
+
+	render_buffer buffer = { 0 };
+	int first = 1;
+
+	for (int vi = 0; vi < num_views; vi++) {
+		if (!use_view[vi])
+			continue;
+
+		for (int si = 0; si < num_sizes; si++) {
+			viewport v;
+			view_at(&views[vi], widths[si], heights[si], &v);
+
+			for (int e = 0; e < SCHED_COUNT; e++) {
+				if (!use_engine[e])
+					continue;
+
+				// The serial engine runs once, the others at each thread count.
+				int nt = e == SCHED_SERIAL ? 1 : num_threads;
+				int nb = e == SCHED_CYCLIC ? num_blocks : 1;
+
+				for (int ti = 0; ti < nt; ti++) {
+					for (int bi = 0; bi < nb; bi++) {
+						render_opts o;
+						bench_result res;
+
+						render_opts_init(&o, e, e == SCHED_SERIAL ? 1 : threads[ti]);
+						o.block_rows = blocks[bi];
+						o.pin = pin;
+						o.precision = precision;
+						o.aa_samples = aa_samples;
+						o.distance = distance;
+						o.equalize = equalize;
+						o.counters = counters;
+
+						run(&v, &o, &buffer, reps, &res);
+						print_result(json, first, views[vi].name, &v, &o, reps, &res);
+						first = 0;
+					}
+				}
+			}
+		}
+	}
+
+	if (json)
+		printf("\n  ]");
+	if (counters)
+		print_kernels(json);
+	if (json)
+		printf("\n}\n");
+
+	render_buffer_free(&buffer);
+	stats_log_close(&output);
+	return 0;
+}
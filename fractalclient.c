@@ -0,0 +1,319 @@
+/*
+fractalclient.c - Ask fractalserver for an image.
+
+Sends one render request on each of -c connections at once and
+reads the tiles back, reporting the time to the first tile and to
+the last.  Several connections asking for the same viewport show
+the server sharing tiles; -q n hangs up after n tiles to show it
+dropping the rest.  -C checks the iteration counts against a local
+render, and -o writes the image as a PPM file.
+*/
+
+#define _GNU_SOURCE
+
+#include "render.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_CONNECTIONS 64
+
+static const char *path = "fractal.sock";
+static int port = 0;
+static viewport view = { -1.5, 0.5, -1.0, 1.0, 640, 640, 1000 };
+static int use_rgb = 0;
+static int quit_after = 0;
+
+typedef struct {
+	int index;
+	pthread_t thread;
+	unsigned char *image;	// the reply, 4 bytes a pixel for iter, 3 for rgb
+	int tiles;
+	int complete;		// "done" arrived
+	double first;
+	double total;
+} connection;
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_server()
+{
+	int fd;
+
+	if (port) {
+		struct sockaddr_in addr;
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+			perror("connect");
+			exit(1);
+		}
+	} else {
+		struct sockaddr_un addr;
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+		if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+			perror(path);
+			exit(1);
+		}
+	}
+	return fd;
+}
+
+static void read_all( FILE *in, void *buf, size_t n )
+{
+	if (fread(buf, 1, n, in) != n) {
+		fprintf(stderr, "fractalclient: connection closed in the middle of a tile\n");
+		exit(1);
+	}
+}
+
+static void *run_connection( void *arg )
+{
+	connection *c = (connection *)arg;
+	int bpp = use_rgb ? 3 : 4;
+	char line[512];
+
+	double start = now();
+	int fd = connect_server();
+	FILE *in = fdopen(fd, "r");
+	if (!in) {
+		perror("fdopen");
+		exit(1);
+	}
+
+	int n = snprintf(line, sizeof(line), "render %d %.17g %.17g %.17g %.17g %d %d %d %s %s %d %.17g %.17g\n",
+		c->index, view.xmin, view.xmax, view.ymin, view.ymax, view.width, view.height, view.maxiter,
+		use_rgb ? "rgb" : "iter", fractal_name(view.fractal), view.power ? view.power : 2, view.kx, view.ky);
+	if (write(fd, line, n) != n) {
+		perror("write");
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), in)) {
+		int id, x, y, w, h;
+		size_t bytes;
+
+		if (sscanf(line, "tile %d %d %d %d %d %zu", &id, &x, &y, &w, &h, &bytes) == 6) {
+			if (x < 0 || y < 0 || w < 1 || h < 1 || x + w > view.width || y + h > view.height ||
+			    bytes != (size_t)w * h * bpp) {
+				fprintf(stderr, "fractalclient: bad tile: %s", line);
+				exit(1);
+			}
+			for (int j = 0; j < h; j++)
+				read_all(in, c->image + ((size_t)(y + j) * view.width + x) * bpp, (size_t)w * bpp);
+			if (c->tiles++ == 0)
+				c->first = now() - start;
+			if (quit_after && c->tiles >= quit_after)
+				break;
+		} else if (!strncmp(line, "done", 4)) {
+			c->complete = 1;
+			break;
+		} else {
+			fprintf(stderr, "fractalclient: %s", line);
+			break;
+		}
+	}
+
+	c->total = now() - start;
+	fclose(in);
+	return NULL;
+}
+
+static void write_ppm( const char *name, const unsigned char *image )
+{
+	FILE *out = fopen(name, "wb");
+	if (!out) {
+		perror(name);
+		exit(1);
+	}
+
+	fprintf(out, "P6\n%d %d\n255\n", view.width, view.height);
+	for (size_t p = 0; p < (size_t)view.width * view.height; p++) {
+		unsigned char rgb[3];
+		if (use_rgb) {
+			memcpy(rgb, image + 3 * p, 3);
+		} else {
+			int iter = image[4 * p] | image[4 * p + 1] << 8 | image[4 * p + 2] << 16 | image[4 * p + 3] << 24;
+			int r, g, b;
+			color_point(iter, view.maxiter, &r, &g, &b);
+			rgb[0] = r;
+			rgb[1] = g;
+			rgb[2] = b;
+		}
+		fwrite(rgb, 1, 3, out);
+	}
+
+	if (fclose(out)) {
+		perror(name);
+		exit(1);
+	}
+}
+
+/* Count the pixels whose iterations differ from a local render. */
+
+static long check_image( const unsigned char *image )
+{
+	size_t pixels = (size_t)view.width * view.height;
+	int *iters = malloc(pixels * sizeof(int));
+	render_opts opts;
+	long diffs = 0;
+
+	if (!iters) {
+		perror("malloc");
+		exit(1);
+	}
+
+	render_opts_init(&opts, SCHED_TILE, render_default_threads());
+	render_image(&view, &opts, iters, NULL, NULL, NULL, NULL);
+
+	for (size_t p = 0; p < pixels; p++) {
+		int iter = image[4 * p] | image[4 * p + 1] << 8 | image[4 * p + 2] << 16 | image[4 * p + 3] << 24;
+		if (iter != iters[p])
+			diffs++;
+	}
+
+	free(iters);
+	return diffs;
+}
+
+static void usage( const char *prog )
+{
+	fprintf(stderr,"usage: %s [-u socket path | -p tcp port] [-V xmin,xmax,ymin,ymax] [-S WxH] [-m maxiter] [-f iter|rgb]\n"
+		"\t[-F fractal] [-N power] [-K kx,ky] [-c connections] [-q tiles] [-o out.ppm] [-C]\n",prog);
+	exit(1);
+}
+
+int main( int argc, char *argv[] )
+{
+	connection conns[MAX_CONNECTIONS];
+	int num_conns = 1;
+	const char *out_name = NULL;
+	int check = 0;
+
+	int c;
+	while ((c = getopt(argc, argv, "u:p:V:S:m:f:F:N:K:c:q:o:C")) != -1) {
+		switch (c) {
+			case 'u':
+				path = optarg;
+				break;
+			case 'p':
+				port = atoi(optarg);
+				if (port < 1 || port > 65535)
+					usage(argv[0]);
+				break;
+			case 'V':
+				if (sscanf(optarg, "%lf,%lf,%lf,%lf", &view.xmin, &view.xmax, &view.ymin, &view.ymax) != 4)
+					usage(argv[0]);
+				break;
+			case 'S':
+				if (sscanf(optarg, "%dx%d", &view.width, &view.height) != 2 || view.width < 1 || view.height < 1)
+					usage(argv[0]);
+				break;
+			case 'm':
+				view.maxiter = atoi(optarg);
+				if (view.maxiter < 1)
+					usage(argv[0]);
+				break;
+			case 'f':
+				if (!strcmp(optarg, "rgb"))
+					use_rgb = 1;
+				else if (strcmp(optarg, "iter"))
+					usage(argv[0]);
+				break;
+			case 'F':
+				view.fractal = fractal_parse(optarg);
+				if (view.fractal < 0)
+					usage(argv[0]);
+				break;
+			case 'N':
+				view.power = atoi(optarg);
+				if (view.power < 2 || view.power > MAX_POWER)
+					usage(argv[0]);
+				break;
+			case 'K':
+				if (sscanf(optarg, "%lf,%lf", &view.kx, &view.ky) != 2)
+					usage(argv[0]);
+				break;
+			case 'c':
+				num_conns = atoi(optarg);
+				if (num_conns < 1 || num_conns > MAX_CONNECTIONS)
+					usage(argv[0]);
+				break;
+			case 'q':
+				quit_after = atoi(optarg);
+				if (quit_after < 1)
+					usage(argv[0]);
+				break;
+			case 'o':
+				out_name = optarg;
+				break;
+			case 'C':
+				check = 1;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind < argc || (check && use_rgb))
+		usage(argv[0]);
+
+	size_t bytes = (size_t)view.width * view.height * (use_rgb ? 3 : 4);
+	for (int i = 0; i < num_conns; i++) {
+		memset(&conns[i], 0, sizeof(connection));
+		conns[i].index = i;
+		conns[i].image = calloc(1, bytes);
+		if (!conns[i].image) {
+			perror("calloc");
+			exit(1);
+		}
+	}
+
+	for (int i = 0; i < num_conns; i++) {
+		if (pthread_create(&conns[i].thread, NULL, run_connection, &conns[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (int i = 0; i < num_conns; i++) {
+		if (pthread_join(conns[i].thread, NULL)) {
+			perror("pthread_join");
+			exit(1);
+		}
+	}
+
+	for (int i = 0; i < num_conns; i++) {
+		connection *cn = &conns[i];
+		printf("connection %d: %d tiles%s, first after %.2f ms, last after %.2f ms",
+			i, cn->tiles, cn->complete ? "" : " (incomplete)", cn->first * 1e3, cn->total * 1e3);
+		if (check && cn->complete)
+			printf(", %ld pixels differ from a local render", check_image(cn->image));
+		printf("\n");
+	}
+
+	if (out_name)
+		write_ppm(out_name, conns[0].image);
+
+	for (int i = 0; i < num_conns; i++)
+		free(conns[i].image);
+
+	return 0;
+}
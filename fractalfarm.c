@@ -0,0 +1,997 @@
+/*
+fractalfarm.c - Render across worker processes and machines.
+
+A coordinator cuts a frame, or a zoom of -f frames, into the square
+tiles fractaltask hands to its threads, and hands them on to worker
+processes over sockets.  Each worker computes tiles on all its
+threads and sends back the iteration counts, which the coordinator
+colors straight into the output files as they arrive.  With -I the
+counts themselves are kept too, in iteration files (see iterfile.h).
+
+	fractalfarm -w 4 -S 8000x8000 -o big	# four local workers
+	fractalfarm -p 7000 -S 8000x8000 -o big	# and on other machines:
+	fractalfarm -c coordinator:7000
+
+Every worker owns a range of consecutive tiles, so it works its way
+along rows of the image.  A worker that runs out steals the second
+half of the largest range left, so fast workers take over the work
+of slow ones, and a new worker joins by stealing too.  Each worker
+has a few tiles per thread in flight.  When a worker goes away, the
+tiles it had in flight are sent to others, and its range is left to
+be stolen.  Once nothing is left to hand out, idle workers are sent
+second copies of tiles still in flight elsewhere, and whichever copy
+comes back first is used, so a slow or stuck worker does not hold
+up the end of the job.
+
+The protocol is line based.  The coordinator sends
+
+	view frame xmin xmax ymin ymax width height maxiter fractal power kx ky precision
+	tile unit x y w h
+
+where each tile belongs to the last view sent, and a worker first
+sends "hello threads", then answers each tile with
+
+	tile unit bytes
+
+followed by that many bytes: the tile's iteration counts, row by row,
+encoded as tilecodec.h describes.
+*/
+
+#define _GNU_SOURCE
+
+#include "render.h"
+#include "iterfile.h"
+#include "tilecodec.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define FARM_CREDIT 4		// tiles in flight per worker thread
+#define FARM_COPIES 2		// most copies of a tile in flight at once
+#define MAX_WORKERS 256		// including the unowned tiles
+#define MAX_SIDE 1000000	// largest image width or height
+#define LINE_MAX_BYTES 512
+
+/*
+A worker as the coordinator sees it.  Entry 0 is not a worker but
+holds the tiles nobody owns yet, as do the entries of workers that
+have gone away.
+*/
+typedef struct {
+	int fd;		// -1 once gone
+	int threads;	// 0 until it said hello
+	int credit;	// tiles it may have in flight
+	long *inflight;
+	int num_inflight;
+	long next;	// its range of units still to hand out
+	long end;
+	int frame_sent;	// the last view sent to it
+	char *buf;	// received, not yet handled
+	size_t len;
+	size_t cap;
+	long tiles;	// tiles it computed that were used
+	long steals;
+	long backups;	// second copies it was sent
+	long wasted;	// copies that came back second
+} farm_worker;
+
+/* A frame being assembled. */
+typedef struct {
+	viewport v;
+	long left;		// tiles still to come
+	unsigned char *map;	// the PPM file, mapped
+	size_t map_size;
+	size_t header;
+	int *iters;		// for -C
+	iterfile *saved;	// for -I
+} farm_frame;
+
+static viewport view = { -1.5, 0.5, -1.0, 1.0, 640, 640, 1000 };
+static int precision = PREC_AUTO;
+static int tile_size = TASK_SIZE;
+static int tiles_x;
+static int tiles_y;
+static int num_frames = 1;
+static double zoom = 2;
+static const char *prefix;
+static const char *iter_prefix;
+static int check;
+static int verbose;
+
+static farm_worker workers[MAX_WORKERS];
+static int num_workers = 1;
+static farm_frame *frames;
+static unsigned char *done;	// per unit: its iterations arrived
+static unsigned char *copies;	// per unit: copies in flight
+static long *retry;		// units whose worker went away
+static long num_retry;
+static long total_units;
+static long done_units;
+static int *tile;		// a tile's counts, decoded
+static long received;		// bytes of encoded counts
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *alloc( size_t bytes )
+{
+	void *ptr = calloc(1, bytes);
+	if (!ptr) {
+		perror("calloc");
+		exit(1);
+	}
+	return ptr;
+}
+
+/*
+Connect to a coordinator at host:port, or at a Unix socket path.
+*/
+
+static int connect_address( const char *address )
+{
+	const char *colon = strrchr(address, ':');
+	int fd;
+
+	if (!colon || strchr(address, '/')) {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, address, sizeof(addr.sun_path) - 1);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+			perror(address);
+			exit(1);
+		}
+		return fd;
+	}
+
+	char host[256];
+	struct addrinfo hints, *res;
+	snprintf(host, sizeof(host), "%.*s", (int)(colon - address), address);
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	int err = getaddrinfo(host, colon + 1, &hints, &res);
+	if (err) {
+		fprintf(stderr, "%s: %s\n", address, gai_strerror(err));
+		exit(1);
+	}
+	fd = socket(res->ai_family, res->ai_socktype, 0);
+	if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen)) {
+		perror(address);
+		exit(1);
+	}
+	freeaddrinfo(res);
+
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+/* The worker side. */
+
+typedef struct farm_tile {
+	long unit;
+	viewport v;
+	int precision;
+	int x;
+	int y;
+	int w;
+	int h;
+	struct farm_tile *next;
+} farm_tile;
+
+static struct {
+	int fd;
+	pthread_mutex_t mutex;
+	pthread_cond_t ready;
+	pthread_mutex_t send_mutex;
+	farm_tile *head;
+	farm_tile *tail;
+} worker;
+
+static void send_all( int fd, const void *buf, size_t n )
+{
+	const char *p = buf;
+
+	while (n > 0) {
+		ssize_t k = send(fd, p, n, MSG_NOSIGNAL);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0) {
+			// The coordinator is gone, and with it the job.
+			exit(0);
+		}
+		p += k;
+		n -= k;
+	}
+}
+
+static void *worker_thread( void *arg )
+{
+	int *iters = NULL;
+	unsigned char *data = NULL;
+	size_t size = 0;
+
+	// Runs until the process exits with the coordinator gone.
+	while (1) {
+		pthread_mutex_lock(&worker.mutex);
+		while (!worker.head)
+			pthread_cond_wait(&worker.ready, &worker.mutex);
+		farm_tile *t = worker.head;
+		worker.head = t->next;
+		if (!worker.head)
+			worker.tail = NULL;
+		pthread_mutex_unlock(&worker.mutex);
+
+		size_t pixels = (size_t)t->w * t->h;
+		if (pixels > size) {
+			free(iters);
+			free(data);
+			iters = alloc(pixels * sizeof(int));
+			data = alloc(tile_encode_bound(pixels, t->v.maxiter));
+			size = pixels;
+		}
+
+		render_opts o;
+		render_opts_init(&o, SCHED_SERIAL, 1);
+		o.precision = t->precision;
+		render_rect(&t->v, &o, t->x, t->y, t->w, t->h, iters);
+
+		size_t bytes = tile_encode(iters, pixels, t->v.maxiter, data);
+
+		char header[64];
+		int n = snprintf(header, sizeof(header), "tile %ld %zu\n", t->unit, bytes);
+		pthread_mutex_lock(&worker.send_mutex);
+		send_all(worker.fd, header, n);
+		send_all(worker.fd, data, bytes);
+		pthread_mutex_unlock(&worker.send_mutex);
+		free(t);
+	}
+
+	return NULL;
+}
+
+/*
+Compute tiles for the coordinator at address on num_threads threads
+until it hangs up.
+*/
+
+static void run_worker( const char *address, int num_threads )
+{
+	pthread_t threads[MAX_THREADS];
+	viewport v = { 0 };
+	int prec = PREC_AUTO;
+	char line[LINE_MAX_BYTES];
+
+	worker.fd = connect_address(address);
+	if (pthread_mutex_init(&worker.mutex, NULL) || pthread_mutex_init(&worker.send_mutex, NULL) ||
+	    pthread_cond_init(&worker.ready, NULL)) {
+		perror("pthread_mutex_init");
+		exit(1);
+	}
+
+	FILE *in = fdopen(worker.fd, "r");
+	if (!in) {
+		perror("fdopen");
+		exit(1);
+	}
+
+	int n = snprintf(line, sizeof(line), "hello %d\n", num_threads);
+	send_all(worker.fd, line, n);
+
+	for (int i = 0; i < num_threads; i++) {
+		if (pthread_create(&threads[i], NULL, worker_thread, NULL)) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	while (fgets(line, sizeof(line), in)) {
+		char fractal[32], prec_name[32];
+		int frame;
+		farm_tile t;
+
+		if (sscanf(line, "view %d %lf %lf %lf %lf %d %d %d %31s %d %lf %lf %31s", &frame,
+		    &v.xmin, &v.xmax, &v.ymin, &v.ymax, &v.width, &v.height, &v.maxiter,
+		    fractal, &v.power, &v.kx, &v.ky, prec_name) == 13) {
+			v.fractal = fractal_parse(fractal);
+			prec = precision_parse(prec_name);
+			if (v.fractal < 0 || prec < 0) {
+				fprintf(stderr, "fractalfarm: unknown fractal or precision: %s", line);
+				exit(1);
+			}
+		} else if (sscanf(line, "tile %ld %d %d %d %d", &t.unit, &t.x, &t.y, &t.w, &t.h) == 5) {
+			farm_tile *copy = alloc(sizeof(farm_tile));
+			*copy = t;
+			copy->v = v;
+			copy->precision = prec;
+			copy->next = NULL;
+
+			pthread_mutex_lock(&worker.mutex);
+			if (worker.tail)
+				worker.tail->next = copy;
+			else
+				worker.head = copy;
+			worker.tail = copy;
+			pthread_cond_signal(&worker.ready);
+			pthread_mutex_unlock(&worker.mutex);
+		} else {
+			fprintf(stderr, "fractalfarm: bad line from the coordinator: %s", line);
+			exit(1);
+		}
+	}
+
+	// The coordinator hung up: the job is done, or abandoned.
+	exit(0);
+}
+
+/* The coordinator side. */
+
+static void unit_rect( long unit, int *frame, int *x, int *y, int *w, int *h )
+{
+	long per_frame = (long)tiles_x * tiles_y;
+	long t = unit % per_frame;
+	const viewport *v = &view;
+
+	*frame = unit / per_frame;
+	*x = (t % tiles_x) * tile_size;
+	*y = (t / tiles_x) * tile_size;
+	*w = *x + tile_size < v->width ? tile_size : v->width - *x;
+	*h = *y + tile_size < v->height ? tile_size : v->height - *y;
+}
+
+/* Frame f zooms in by a factor of zoom per frame, about the center of view. */
+
+static void frame_view( int f, viewport *v )
+{
+	double scale = pow(zoom, -f);
+	double cx = (view.xmin + view.xmax) / 2;
+	double cy = (view.ymin + view.ymax) / 2;
+	double rx = (view.xmax - view.xmin) / 2 * scale;
+	double ry = (view.ymax - view.ymin) / 2 * scale;
+
+	*v = view;
+	v->xmin = cx - rx;
+	v->xmax = cx + rx;
+	v->ymin = cy - ry;
+	v->ymax = cy + ry;
+}
+
+static void lose_worker( farm_worker *w );
+
+static int send_line( farm_worker *w, const char *line, int n )
+{
+	const char *p = line;
+
+	while (n > 0) {
+		ssize_t k = send(w->fd, p, n, MSG_NOSIGNAL);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0) {
+			lose_worker(w);
+			return 0;
+		}
+		p += k;
+		n -= k;
+	}
+	return 1;
+}
+
+/*
+The unit counts as in flight on w before anything is sent, so if w
+goes away halfway, lose_worker hands it on with the rest.
+*/
+
+static int send_unit( farm_worker *w, long unit )
+{
+	char line[LINE_MAX_BYTES];
+	int frame, x, y, width, height;
+	unit_rect(unit, &frame, &x, &y, &width, &height);
+
+	w->inflight[w->num_inflight++] = unit;
+	copies[unit]++;
+
+	if (frame != w->frame_sent) {
+		const viewport *v = &frames[frame].v;
+		int n = snprintf(line, sizeof(line), "view %d %.17g %.17g %.17g %.17g %d %d %d %s %d %.17g %.17g %s\n",
+			frame, v->xmin, v->xmax, v->ymin, v->ymax, v->width, v->height, v->maxiter,
+			fractal_name(v->fractal), v->power ? v->power : 2, v->kx, v->ky, precision_name(precision));
+		if (!send_line(w, line, n))
+			return 0;
+		w->frame_sent = frame;
+	}
+
+	int n = snprintf(line, sizeof(line), "tile %ld %d %d %d %d\n", unit, x, y, width, height);
+	return send_line(w, line, n);
+}
+
+/*
+Steal for w the second half of the largest range left, taking even
+a single tile from the ranges nobody works on any more.
+*/
+
+static int steal( farm_worker *w )
+{
+	farm_worker *victim = NULL;
+	long most = 0;
+
+	for (int i = 0; i < num_workers; i++) {
+		farm_worker *v = &workers[i];
+		long left = v->end - v->next;
+		if (v == w || left < (v->fd >= 0 ? 2 : 1) || left <= most)
+			continue;
+		victim = v;
+		most = left;
+	}
+	if (!victim)
+		return 0;
+
+	long take = victim->fd >= 0 ? most / 2 : (most + 1) / 2;
+	w->next = victim->end - take;
+	w->end = victim->end;
+	victim->end -= take;
+	if (victim != &workers[0])
+		w->steals++;
+	return 1;
+}
+
+/* A unit for w that is in flight on another worker and has no second copy yet. */
+
+static long backup_unit( farm_worker *w )
+{
+	for (int i = 1; i < num_workers; i++) {
+		farm_worker *v = &workers[i];
+		if (v == w || v->fd < 0)
+			continue;
+		for (int k = 0; k < v->num_inflight; k++) {
+			long unit = v->inflight[k];
+			if (!done[unit] && copies[unit] < FARM_COPIES)
+				return unit;
+		}
+	}
+	return -1;
+}
+
+/* Hand w tiles until its credit is used up. */
+
+static void fill( farm_worker *w )
+{
+	while (w->fd >= 0 && w->num_inflight < w->credit) {
+		long unit;
+
+		if (num_retry > 0) {
+			unit = retry[--num_retry];
+			if (done[unit])
+				continue;
+		} else if (w->next < w->end || steal(w)) {
+			unit = w->next++;
+			if (done[unit])
+				continue;
+		} else {
+			unit = backup_unit(w);
+			if (unit < 0)
+				break;
+			w->backups++;
+		}
+
+		if (!send_unit(w, unit))
+			break;
+	}
+}
+
+static void fill_all()
+{
+	for (int i = 1; i < num_workers; i++)
+		fill(&workers[i]);
+}
+
+/* w is gone: its tiles in flight go to the others. */
+
+static void lose_worker( farm_worker *w )
+{
+	if (w->fd < 0)
+		return;
+	close(w->fd);
+	w->fd = -1;
+
+	for (int k = 0; k < w->num_inflight; k++) {
+		long unit = w->inflight[k];
+		if (--copies[unit] == 0 && !done[unit])
+			retry[num_retry++] = unit;
+	}
+	w->num_inflight = 0;
+
+	if (done_units < total_units)
+		fprintf(stderr, "fractalfarm: worker %d went away with %ld tiles of its range left\n",
+			(int)(w - workers), w->end - w->next);
+}
+
+static void write_header( farm_frame *fr, int f )
+{
+	char path[4096], header[64];
+	snprintf(path, sizeof(path), "%s%05d.ppm", prefix, f);
+
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+
+	fr->header = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", fr->v.width, fr->v.height);
+	fr->map_size = fr->header + (size_t)fr->v.width * fr->v.height * 3;
+	if (ftruncate(fd, fr->map_size)) {
+		perror(path);
+		exit(1);
+	}
+	fr->map = mmap(NULL, fr->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (fr->map == MAP_FAILED) {
+		perror(path);
+		exit(1);
+	}
+	close(fd);
+	memcpy(fr->map, header, fr->header);
+}
+
+/* Count the pixels of frame f that differ from a local render. */
+
+static long check_frame( farm_frame *fr )
+{
+	size_t pixels = (size_t)fr->v.width * fr->v.height;
+	int *iters = alloc(pixels * sizeof(int));
+	render_opts opts;
+	long diffs = 0;
+
+	render_opts_init(&opts, SCHED_TILE, render_default_threads());
+	opts.precision = precision;
+	render_image(&fr->v, &opts, iters, NULL, NULL, NULL, NULL);
+
+	for (size_t p = 0; p < pixels; p++) {
+		if (iters[p] != fr->iters[p])
+			diffs++;
+	}
+
+	free(iters);
+	return diffs;
+}
+
+static void finish_frame( int f )
+{
+	farm_frame *fr = &frames[f];
+
+	if (fr->map) {
+		munmap(fr->map, fr->map_size);
+		fr->map = NULL;
+	}
+	if (fr->saved) {
+		iterfile_close(fr->saved);
+		free(fr->saved);
+		fr->saved = NULL;
+	}
+	if (fr->iters) {
+		printf("frame %d: %ld pixels differ from a local render\n", f, check_frame(fr));
+		free(fr->iters);
+		fr->iters = NULL;
+	}
+}
+
+static void store_tile( long unit, const int *tile )
+{
+	int f, x, y, w, h;
+	unit_rect(unit, &f, &x, &y, &w, &h);
+	farm_frame *fr = &frames[f];
+
+	if (prefix && !fr->map)
+		write_header(fr, f);
+
+	// The iteration file has the farm's tiles, so each tile is a single write.
+	if (iter_prefix) {
+		if (!fr->saved) {
+			char path[4096];
+			snprintf(path, sizeof(path), "%s%05d.iter", iter_prefix, f);
+			fr->saved = alloc(sizeof(iterfile));
+			iterfile_create(fr->saved, path, &fr->v, render_precision(&fr->v, precision), tile_size, 0);
+		}
+		iterfile_write(fr->saved, x, y, w, h, tile, NULL, w);
+	}
+
+	for (int j = 0; j < h; j++) {
+		for (int i = 0; i < w; i++) {
+			int iter = tile[j * w + i];
+			size_t pixel = (size_t)(y + j) * fr->v.width + x + i;
+
+			if (fr->map) {
+				int r, g, b;
+				unsigned char *rgb = fr->map + fr->header + 3 * pixel;
+				color_point(iter, fr->v.maxiter, &r, &g, &b);
+				rgb[0] = r;
+				rgb[1] = g;
+				rgb[2] = b;
+			}
+			if (fr->iters)
+				fr->iters[pixel] = iter;
+		}
+	}
+
+	if (--fr->left == 0)
+		finish_frame(f);
+}
+
+/*
+Handle the messages w has sent in full.  Return 0 if it sent
+something it should not have, which loses it.
+*/
+
+static int handle_messages( farm_worker *w )
+{
+	size_t used = 0;
+
+	while (used < w->len) {
+		char *line = w->buf + used;
+		char *end = memchr(line, '\n', w->len - used);
+		if (!end)
+			break;
+		size_t header = end - line + 1;
+		long unit;
+		size_t bytes;
+		int threads;
+
+		if (sscanf(line, "hello %d", &threads) == 1 && w->threads == 0 && threads > 0) {
+			w->threads = threads;
+			w->credit = threads * FARM_CREDIT;
+			w->inflight = alloc(w->credit * sizeof(long));
+			used += header;
+			fill(w);
+			continue;
+		}
+
+		if (sscanf(line, "tile %ld %zu", &unit, &bytes) != 2 || unit < 0 || unit >= total_units)
+			return 0;
+		int f, x, y, width, height;
+		unit_rect(unit, &f, &x, &y, &width, &height);
+		if (bytes > tile_encode_bound(width * height, frames[f].v.maxiter))
+			return 0;
+		if (w->len - used < header + bytes)
+			break;
+
+		int k = 0;
+		while (k < w->num_inflight && w->inflight[k] != unit)
+			k++;
+		if (k == w->num_inflight)
+			return 0;
+		w->inflight[k] = w->inflight[--w->num_inflight];
+		copies[unit]--;
+
+		received += bytes;
+		if (done[unit]) {
+			w->wasted++;
+		} else {
+			if (tile_decode((unsigned char *)line + header, bytes, frames[f].v.maxiter, tile, width * height))
+				return 0;
+			done[unit] = 1;
+			done_units++;
+			w->tiles++;
+			store_tile(unit, tile);
+		}
+		used += header + bytes;
+		fill(w);
+	}
+
+	memmove(w->buf, w->buf + used, w->len - used);
+	w->len -= used;
+	return 1;
+}
+
+static void read_worker( farm_worker *w )
+{
+	if (w->cap - w->len < 65536) {
+		w->cap = w->cap ? w->cap * 2 : 1 << 20;
+		w->buf = realloc(w->buf, w->cap);
+		if (!w->buf) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	ssize_t n = recv(w->fd, w->buf + w->len, w->cap - w->len, MSG_DONTWAIT);
+	if (n < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+	if (n <= 0) {
+		lose_worker(w);
+		fill_all();
+		return;
+	}
+
+	w->len += n;
+	if (!handle_messages(w)) {
+		fprintf(stderr, "fractalfarm: worker %d sent garbage\n", (int)(w - workers));
+		lose_worker(w);
+	}
+	if (w->fd < 0)
+		fill_all();
+}
+
+static int listen_address( const char *path, int port )
+{
+	int fd;
+
+	if (port) {
+		struct sockaddr_in addr;
+		int one = 1;
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0) {
+			perror("socket");
+			exit(1);
+		}
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 64)) {
+			perror("bind");
+			exit(1);
+		}
+		return fd;
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: socket path too long\n", path);
+		exit(1);
+	}
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 64)) {
+		perror(path);
+		exit(1);
+	}
+	return fd;
+}
+
+static void usage( const char *prog )
+{
+	fprintf(stderr,"usage: %s [-u socket path | -p tcp port] [-w local workers] [-n threads each] [-V xmin,xmax,ymin,ymax]\n"
+		"\t[-S WxH] [-m maxiter] [-t tile size] [-f frames] [-z zoom per frame] [-o prefix] [-I prefix] [-F fractal] [-N power]\n"
+		"\t[-K kx,ky] [-P precision] [-C] [-v]\n"
+		"   or: %s -c coordinator [-n threads]\n",prog,prog);
+	exit(1);
+}
+
+int main( int argc, char *argv[] )
+{
+	const char *path = "fractalfarm.sock";
+	const char *coordinator = NULL;
+	char address[64];
+	int port = 0;
+	int local = 0;
+	int num_threads = 0;
+
+	int c;
+	while ((c = getopt(argc, argv, "u:p:c:w:n:V:S:m:t:f:z:o:I:F:N:K:P:Cv")) != -1) {
+		switch (c) {
+			case 'u':
+				path = optarg;
+				break;
+			case 'p':
+				port = atoi(optarg);
+				if (port < 1 || port > 65535)
+					usage(argv[0]);
+				break;
+			case 'c':
+				coordinator = optarg;
+				break;
+			case 'w':
+				local = atoi(optarg);
+				if (local < 0 || local >= MAX_WORKERS)
+					usage(argv[0]);
+				break;
+			case 'n':
+				num_threads = atoi(optarg);
+				if (num_threads < 1 || num_threads > MAX_THREADS)
+					usage(argv[0]);
+				break;
+			case 'V':
+				if (sscanf(optarg, "%lf,%lf,%lf,%lf", &view.xmin, &view.xmax, &view.ymin, &view.ymax) != 4)
+					usage(argv[0]);
+				break;
+			case 'S':
+				if (sscanf(optarg, "%dx%d", &view.width, &view.height) != 2 || view.width < 1 || view.height < 1 ||
+				    view.width > MAX_SIDE || view.height > MAX_SIDE)
+					usage(argv[0]);
+				break;
+			case 'm':
+				view.maxiter = atoi(optarg);
+				if (view.maxiter < 1)
+					usage(argv[0]);
+				break;
+			case 't':
+				tile_size = atoi(optarg);
+				if (tile_size < 1)
+					usage(argv[0]);
+				break;
+			case 'f':
+				num_frames = atoi(optarg);
+				if (num_frames < 1)
+					usage(argv[0]);
+				break;
+			case 'z':
+				zoom = atof(optarg);
+				if (zoom <= 0)
+					usage(argv[0]);
+				break;
+			case 'o':
+				prefix = optarg;
+				break;
+			case 'I':
+				iter_prefix = optarg;
+				break;
+			case 'F':
+				view.fractal = fractal_parse(optarg);
+				if (view.fractal < 0)
+					usage(argv[0]);
+				break;
+			case 'N':
+				view.power = atoi(optarg);
+				if (view.power < 2 || view.power > MAX_POWER)
+					usage(argv[0]);
+				break;
+			case 'K':
+				if (sscanf(optarg, "%lf,%lf", &view.kx, &view.ky) != 2)
+					usage(argv[0]);
+				break;
+			case 'P':
+				precision = precision_parse(optarg);
+				if (precision < 0)
+					usage(argv[0]);
+				break;
+			case 'C':
+				check = 1;
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		usage(argv[0]);
+
+	if (coordinator)
+		run_worker(coordinator, num_threads ? num_threads : render_default_threads());
+
+	signal(SIGPIPE, SIG_IGN);
+	int listen_fd = listen_address(path, port);
+	if (port)
+		snprintf(address, sizeof(address), "127.0.0.1:%d", port);
+	else
+		snprintf(address, sizeof(address), "%s", path);
+
+	tiles_x = (view.width + tile_size - 1) / tile_size;
+	tiles_y = (view.height + tile_size - 1) / tile_size;
+	total_units = (long)tiles_x * tiles_y * num_frames;
+	tile = alloc((size_t)tile_size * tile_size * sizeof(int));
+	done = alloc(total_units);
+	copies = alloc(total_units);
+	retry = alloc(total_units * sizeof(long));
+	frames = alloc(num_frames * sizeof(farm_frame));
+	for (int f = 0; f < num_frames; f++) {
+		frame_view(f, &frames[f].v);
+		frames[f].left = (long)tiles_x * tiles_y;
+		if (check)
+			frames[f].iters = alloc((size_t)view.width * view.height * sizeof(int));
+	}
+
+	// Entry 0 starts with every tile.
+	workers[0].fd = -1;
+	workers[0].end = total_units;
+
+	// Local workers split the cpus between them.
+	if (local && !num_threads)
+		num_threads = render_default_threads() / local > 0 ? render_default_threads() / local : 1;
+	for (int i = 0; i < local; i++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			exit(1);
+		}
+		if (pid == 0) {
+			close(listen_fd);
+			run_worker(address, num_threads);
+		}
+		if (verbose)
+			fprintf(stderr, "fractalfarm: local worker %d is pid %d\n", i + 1, (int)pid);
+	}
+
+	fprintf(stderr, "fractalfarm: %d frames of %dx%d in %ld tiles, waiting for workers on %s\n",
+		num_frames, view.width, view.height, total_units, address);
+
+	double start = now();
+
+	while (done_units < total_units) {
+		struct pollfd fds[MAX_WORKERS];
+		farm_worker *polled[MAX_WORKERS];
+		int n = 0;
+
+		fds[n].fd = listen_fd;
+		fds[n].events = num_workers < MAX_WORKERS ? POLLIN : 0;
+		polled[n++] = NULL;
+		for (int i = 1; i < num_workers; i++) {
+			if (workers[i].fd < 0)
+				continue;
+			fds[n].fd = workers[i].fd;
+			fds[n].events = POLLIN;
+			polled[n++] = &workers[i];
+		}
+
+		if (poll(fds, n, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			exit(1);
+		}
+
+		for (int i = 1; i < n; i++) {
+			if (fds[i].revents)
+				read_worker(polled[i]);
+		}
+
+		if (fds[0].revents & POLLIN) {
+			int fd = accept(listen_fd, NULL, NULL);
+			if (fd >= 0) {
+				farm_worker *w = &workers[num_workers++];
+				w->fd = fd;
+				w->frame_sent = -1;
+			}
+		}
+	}
+
+	double wall = now() - start;
+
+	// Hanging up tells the workers the job is done.
+	for (int i = 1; i < num_workers; i++)
+		lose_worker(&workers[i]);
+	close(listen_fd);
+	if (!port)
+		unlink(path);
+	while (wait(NULL) > 0)
+		;
+
+	long pixels = (long)view.width * view.height * num_frames;
+	fprintf(stderr, "farm: %d frames, %ld tiles in %.3fs, %.2f Mpixels/s, %d workers, %.1f bits a pixel received\n",
+		num_frames, total_units, wall, pixels / wall / 1e6, num_workers - 1, received * 8.0 / pixels);
+	if (verbose) {
+		for (int i = 1; i < num_workers; i++) {
+			farm_worker *w = &workers[i];
+			fprintf(stderr, "worker %d: %d threads, %ld tiles, %ld steals, %ld second copies, %ld came back second\n",
+				i, w->threads, w->tiles, w->steals, w->backups, w->wasted);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,409 @@
+/*
+fractaliter.c - Make and use iteration files.
+
+	fractaliter render [render options] -o out.iter
+	fractaliter info file.iter
+	fractaliter color [-m maxiter] file.iter out.ppm
+	fractaliter crop x,y,w,h file.iter out.iter
+	fractaliter downsample factor file.iter out.iter
+	fractaliter compare a.iter b.iter
+
+render computes a frame and streams each tile to the file as its
+thread finishes it; with -D it stores distances as well, computing
+every pixel rather than filling exterior discs.  The rest work from the mapped file and compute
+nothing: color uses the usual palette, stretched over -m iterations
+if given; crop and downsample write a new file for the part or the
+scale of the plane that they cover; compare counts the pixels that
+differ and exits with 1 if any do.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "render.h"
+#include "iterfile.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *alloc( size_t bytes )
+{
+	void *ptr = malloc(bytes);
+	if (!ptr) {
+		perror("malloc");
+		exit(1);
+	}
+	return ptr;
+}
+
+static void usage( const char *prog )
+{
+	fprintf(stderr,"usage: %s render [-V xmin,xmax,ymin,ymax] [-S WxH] [-m maxiter] [-F fractal] [-N power] [-K kx,ky]\n"
+		"\t\t[-P precision] [-n threads] [-t tile size] [-D] -o out.iter\n"
+		"       %s info file.iter\n"
+		"       %s color [-m maxiter] file.iter out.ppm\n"
+		"       %s crop x,y,w,h file.iter out.iter\n"
+		"       %s downsample factor file.iter out.iter\n"
+		"       %s compare a.iter b.iter\n",prog,prog,prog,prog,prog,prog);
+	exit(1);
+}
+
+static int render( int argc, char *argv[] )
+{
+	viewport v = { -1.5, 0.5, -1.0, 1.0, 640, 640, 1000 };
+	render_opts opts;
+	const char *out = NULL;
+	int with_dist = 0;
+
+	render_opts_init(&opts, SCHED_TILE, render_default_threads());
+
+	int c;
+	while ((c = getopt(argc, argv, "V:S:m:F:N:K:P:n:t:Do:")) != -1) {
+		switch (c) {
+			case 'V':
+				if (sscanf(optarg, "%lf,%lf,%lf,%lf", &v.xmin, &v.xmax, &v.ymin, &v.ymax) != 4)
+					usage(argv[0]);
+				break;
+			case 'S':
+				if (sscanf(optarg, "%dx%d", &v.width, &v.height) != 2 || v.width < 1 || v.height < 1)
+					usage(argv[0]);
+				break;
+			case 'm':
+				v.maxiter = atoi(optarg);
+				if (v.maxiter < 1)
+					usage(argv[0]);
+				break;
+			case 'F':
+				v.fractal = fractal_parse(optarg);
+				if (v.fractal < 0)
+					usage(argv[0]);
+				break;
+			case 'N':
+				v.power = atoi(optarg);
+				if (v.power < 2 || v.power > MAX_POWER)
+					usage(argv[0]);
+				break;
+			case 'K':
+				if (sscanf(optarg, "%lf,%lf", &v.kx, &v.ky) != 2)
+					usage(argv[0]);
+				break;
+			case 'P':
+				opts.precision = precision_parse(optarg);
+				if (opts.precision < 0)
+					usage(argv[0]);
+				break;
+			case 'n':
+				opts.num_threads = atoi(optarg);
+				if (opts.num_threads < 1 || opts.num_threads > MAX_THREADS)
+					usage(argv[0]);
+				break;
+			case 't':
+				opts.tile_size = atoi(optarg);
+				if (opts.tile_size < 1)
+					usage(argv[0]);
+				break;
+			case 'D':
+				with_dist = 1;
+				opts.distance = 1;
+				// The file holds every pixel's real count, so none may be filled in instead.
+				opts.fill = 0;
+				break;
+			case 'o':
+				out = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind < argc || !out)
+		usage(argv[0]);
+
+	size_t pixels = (size_t)v.width * v.height;
+	int *iters = alloc(pixels * sizeof(int));
+	float *dist = with_dist ? alloc(pixels * sizeof(float)) : NULL;
+	unsigned int *colors = alloc(pixels * sizeof(unsigned int));
+
+	// The file's tiles are the render's, so each finished tile is one write.
+	iterfile f;
+	int precision = render_precision(&v, opts.precision);
+	if (with_dist && precision == PREC_FLOAT)
+		precision = PREC_DOUBLE;
+	iterfile_create(&f, out, &v, precision, opts.tile_size, with_dist);
+	iterfile_sink sink = { &f, iters, dist };
+
+	double start = now();
+	render_image(&v, &opts, iters, dist, colors, iterfile_draw, &sink);
+	double wall = now() - start;
+	iterfile_close(&f);
+
+	fprintf(stderr, "render: %dx%d in %.3fs to %s\n", v.width, v.height, wall, out);
+	free(iters);
+	free(dist);
+	free(colors);
+	return 0;
+}
+
+static int info( const char *path )
+{
+	iterfile f;
+	iterfile_open(&f, path);
+	const iterfile_header *h = &f.h;
+
+	int tiles = 0;
+	for (int ty = 0; ty < f.tiles_y; ty++) {
+		for (int tx = 0; tx < f.tiles_x; tx++)
+			tiles += iterfile_tile_done(&f, tx, ty);
+	}
+
+	printf("%s: %ux%u, maxiter %d, %s power %d", path, h->width, h->height, h->maxiter,
+		fractal_name(h->fractal), h->power);
+	if (h->fractal == FRACTAL_JULIA)
+		printf(" k %.17g,%.17g", h->kx, h->ky);
+	printf("\n\tview %.17g,%.17g,%.17g,%.17g\n", h->xmin, h->xmax, h->ymin, h->ymax);
+	printf("\t%s precision, %s, tiles of %u, %d of %d complete\n", precision_name(h->precision),
+		f.dist ? "with distances" : "no distances", h->tile_size, tiles, f.tiles_x * f.tiles_y);
+
+	iterfile_close(&f);
+	return 0;
+}
+
+static int color( int argc, char *argv[] )
+{
+	int maxiter = 0;
+
+	int c;
+	while ((c = getopt(argc, argv, "m:")) != -1) {
+		switch (c) {
+			case 'm':
+				maxiter = atoi(optarg);
+				if (maxiter < 1)
+					usage(argv[0]);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2)
+		usage(argv[0]);
+
+	iterfile f;
+	iterfile_open(&f, argv[optind]);
+	if (!maxiter)
+		maxiter = f.h.maxiter;
+
+	FILE *out = fopen(argv[optind + 1], "wb");
+	if (!out) {
+		perror(argv[optind + 1]);
+		exit(1);
+	}
+	fprintf(out, "P6\n%u %u\n255\n", f.h.width, f.h.height);
+
+	int *row = alloc(f.h.width * sizeof(int));
+	unsigned char *rgb = alloc(f.h.width * 3);
+	for (unsigned int y = 0; y < f.h.height; y++) {
+		iterfile_read(&f, 0, y, f.h.width, 1, row, NULL, f.h.width);
+		for (unsigned int x = 0; x < f.h.width; x++) {
+			// Points in the set stay black, and no others turn black, whatever the scale.
+			int iter = row[x] >= f.h.maxiter ? maxiter : row[x] < maxiter ? row[x] : maxiter - 1;
+			int r, g, b;
+			color_point(iter, maxiter, &r, &g, &b);
+			rgb[3 * x] = r;
+			rgb[3 * x + 1] = g;
+			rgb[3 * x + 2] = b;
+		}
+		fwrite(rgb, 1, f.h.width * 3, out);
+	}
+
+	if (fclose(out)) {
+		perror(argv[optind + 1]);
+		exit(1);
+	}
+	free(row);
+	free(rgb);
+	iterfile_close(&f);
+	return 0;
+}
+
+/* The viewport of the w x h pixels at x,y of v, at the same pixel spacing. */
+
+static viewport sub_view( const viewport *v, int x, int y, int w, int h )
+{
+	double dx = (v->xmax - v->xmin) / v->width;
+	double dy = (v->ymax - v->ymin) / v->height;
+	viewport s = *v;
+
+	s.xmin = v->xmin + x * dx;
+	s.xmax = v->xmin + (x + w) * dx;
+	s.ymin = v->ymin + y * dy;
+	s.ymax = v->ymin + (y + h) * dy;
+	s.width = w;
+	s.height = h;
+	return s;
+}
+
+static int crop( const char *rect, const char *in, const char *out )
+{
+	int x, y, w, h;
+	iterfile f, g;
+
+	iterfile_open(&f, in);
+	if (sscanf(rect, "%d,%d,%d,%d", &x, &y, &w, &h) != 4 || x < 0 || y < 0 || w < 1 || h < 1 ||
+	    x + w > (int)f.h.width || y + h > (int)f.h.height) {
+		fprintf(stderr, "%s: %s is not inside the %ux%u image\n", in, rect, f.h.width, f.h.height);
+		exit(1);
+	}
+
+	viewport v = sub_view(&f.v, x, y, w, h);
+	iterfile_create(&g, out, &v, f.h.precision, f.h.tile_size, f.dist != NULL);
+
+	// A band of tile rows at a time keeps the copy small and the writes whole.
+	int band = f.h.tile_size;
+	int *iters = alloc((size_t)w * band * sizeof(int));
+	float *dist = f.dist ? alloc((size_t)w * band * sizeof(float)) : NULL;
+	for (int j = 0; j < h; j += band) {
+		int rows = h - j < band ? h - j : band;
+		iterfile_read(&f, x, y + j, w, rows, iters, dist, w);
+		iterfile_write(&g, 0, j, w, rows, iters, dist, w);
+	}
+
+	free(iters);
+	free(dist);
+	iterfile_close(&g);
+	iterfile_close(&f);
+	return 0;
+}
+
+/*
+Each output pixel gets the mean of the factor x factor block it
+covers, with the block counted as in the set only if all of it is.
+*/
+
+static int downsample( const char *factor_arg, const char *in, const char *out )
+{
+	int factor = atoi(factor_arg);
+	iterfile f, g;
+
+	iterfile_open(&f, in);
+	if (factor < 1 || factor > (int)f.h.width || factor > (int)f.h.height) {
+		fprintf(stderr, "%s: cannot downsample %ux%u by %s\n", in, f.h.width, f.h.height, factor_arg);
+		exit(1);
+	}
+
+	int w = f.h.width / factor;
+	int h = f.h.height / factor;
+	viewport v = sub_view(&f.v, 0, 0, w * factor, h * factor);
+	v.width = w;
+	v.height = h;
+	iterfile_create(&g, out, &v, f.h.precision, f.h.tile_size, f.dist != NULL);
+
+	int *src = alloc((size_t)w * factor * factor * sizeof(int));
+	float *sdist = f.dist ? alloc((size_t)w * factor * factor * sizeof(float)) : NULL;
+	int *iters = alloc(w * sizeof(int));
+	float *dist = alloc(w * sizeof(float));
+	for (int y = 0; y < h; y++) {
+		iterfile_read(&f, 0, y * factor, w * factor, factor, src, sdist, w * factor);
+		for (int x = 0; x < w; x++) {
+			long sum = 0;
+			int inside = 1;
+			float dsum = 0;
+			for (int j = 0; j < factor; j++) {
+				for (int i = 0; i < factor; i++) {
+					size_t k = (size_t)j * w * factor + x * factor + i;
+					sum += src[k];
+					inside &= src[k] >= f.h.maxiter;
+					if (sdist)
+						dsum += sdist[k];
+				}
+			}
+			iters[x] = inside ? f.h.maxiter : (sum / (factor * factor) < f.h.maxiter ? sum / (factor * factor) : f.h.maxiter - 1);
+			// Distances are in pixels, which are now factor times larger.
+			dist[x] = dsum / (factor * factor) / factor;
+		}
+		iterfile_write(&g, 0, y, w, 1, iters, sdist ? dist : NULL, w);
+	}
+
+	free(src);
+	free(sdist);
+	free(iters);
+	free(dist);
+	iterfile_close(&g);
+	iterfile_close(&f);
+	return 0;
+}
+
+/* Field by field, as a viewport has padding memcmp would compare. */
+
+static int same_view( const viewport *a, const viewport *b )
+{
+	return a->xmin == b->xmin && a->xmax == b->xmax && a->ymin == b->ymin && a->ymax == b->ymax &&
+		a->width == b->width && a->height == b->height && a->maxiter == b->maxiter &&
+		a->fractal == b->fractal && a->power == b->power && a->kx == b->kx && a->ky == b->ky;
+}
+
+static int compare( const char *a_path, const char *b_path )
+{
+	iterfile a, b;
+
+	iterfile_open(&a, a_path);
+	iterfile_open(&b, b_path);
+	if (a.h.width != b.h.width || a.h.height != b.h.height) {
+		printf("%s is %ux%u, %s is %ux%u\n", a_path, a.h.width, a.h.height, b_path, b.h.width, b.h.height);
+		return 1;
+	}
+	if (!same_view(&a.v, &b.v))
+		printf("the views differ\n");
+
+	// The tile sizes may differ, so b is read back in rows.
+	long diffs = 0;
+	int largest = 0;
+	int *row = alloc(b.h.width * sizeof(int));
+	for (unsigned int y = 0; y < a.h.height; y++) {
+		iterfile_read(&b, 0, y, b.h.width, 1, row, NULL, b.h.width);
+		for (unsigned int x = 0; x < a.h.width; x++) {
+			int d = abs(a.iters[iterfile_index(&a, x, y)] - row[x]);
+			diffs += d != 0;
+			if (d > largest)
+				largest = d;
+		}
+	}
+
+	printf("%ld of %lu pixels differ, by up to %d iterations\n", diffs, (unsigned long)a.h.width * a.h.height, largest);
+	free(row);
+	iterfile_close(&a);
+	iterfile_close(&b);
+	return diffs > 0;
+}
+
+int main( int argc, char *argv[] )
+{
+	if (argc < 2)
+		usage(argv[0]);
+
+	const char *command = argv[1];
+	argv[1] = argv[0];
+
+	if (!strcmp(command, "render"))
+		return render(argc - 1, argv + 1);
+	if (!strcmp(command, "color"))
+		return color(argc - 1, argv + 1);
+	if (!strcmp(command, "info") && argc == 3)
+		return info(argv[2]);
+	if (!strcmp(command, "crop") && argc == 5)
+		return crop(argv[2], argv[3], argv[4]);
+	if (!strcmp(command, "downsample") && argc == 5)
+		return downsample(argv[2], argv[3], argv[4]);
+	if (!strcmp(command, "compare") && argc == 4)
+		return compare(argv[2], argv[3]);
+
+	usage(argv[0]);
+	return 1;
+}
@@ -0,0 +1,1080 @@
+/*
+fractalserver.c - Serve rendered tiles over a socket.
+
+One warm engine for several viewers and scripts: the server keeps a
+worker pool and a cache of computed tiles, and clients ask for images
+over a Unix socket (-u path, fractal.sock by default) or a TCP port
+on localhost (-p port).
+
+The protocol is line based.  A client sends
+
+	render id xmin xmax ymin ymax width height maxiter format [fractal power kx ky]
+	cancel id
+
+where format is "iter" or "rgb".  The server answers the image a
+rectangle at a time, each as it is ready, with the line
+
+	tile id x y w h bytes
+
+followed by that many bytes: w*h little-endian 32 bit iteration
+counts, or w*h RGB triples, row by row.  "done id" follows the last
+tile of a request, also when it was cancelled, and "error id message"
+answers a bad one.
+
+Tiles are the cells of a grid of SERVER_TILE pixels laid on the
+plane at the request's pixel spacing, so requests for the same view
+share their tiles, and so do views panned from it by whole pixels:
+a tile already waited for by another request is only computed once,
+and each request is sent the part of it inside its image.  Finished
+tiles stay in a cache of CACHE_TILES, encoded as tilecodec.h
+describes, which keeps them several times smaller.  A view whose
+corner is more than GRID_REACH pixels from the origin gets a grid of
+its own, starting at its corner.  A tile is computed at its cell's
+place on the grid, which follows from its key alone, so what a
+request gets never depends on which requests came before it.  Those
+pixels can differ from the request's own in the last bits, so a few
+at the edge of the set may still come out differently than a render
+of the request's own view.
+
+Tiles are computed in batches on the worker pool, and a batch skips
+tiles whose every request has been cancelled or whose clients have
+gone away.
+
+One dispatcher thread computes the batches and queues every reply,
+so tiles never interleave on a socket.  Replies go out as each socket
+takes them, without blocking, and what a socket does not take waits in
+its client's queue for the main thread, which accepts connections,
+reads requests and writes those queues out as their sockets drain.
+Once CLIENT_QUEUE bytes wait for a client that is not reading, its
+further tiles are held back until it catches up, and tiles only it
+wants are not computed meanwhile, so one stalled client neither holds
+up the others nor grows without bound.
+*/
+
+#define _GNU_SOURCE
+
+#include "render.h"
+#include "tilecodec.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SERVER_TILE 64		// edge of a tile
+#define CACHE_TILES 4096	// finished tiles kept for later requests
+#define BATCH_PER_THREAD 4	// tiles per worker in one batch
+#define HASH_SIZE 8192
+#define MAX_CLIENTS 256
+#define REQUEST_MAX 512		// longest request line
+#define MAX_SIDE 16384		// largest image width or height
+#define CLIENT_QUEUE (1 << 20)	// reply bytes waiting for a client past which its tiles are held back
+#define GRID_PHASE 65536	// views line up when their corners agree to 1/GRID_PHASE of a pixel
+#define GRID_REACH 1e9		// and lie within this many pixels of the origin
+#define SPACING_BITS 44		// pixel spacings are rounded to this many bits to share a grid
+
+#define FORMAT_ITER 0
+#define FORMAT_RGB  1
+
+#define TILE_QUEUED  0
+#define TILE_RUNNING 1
+#define TILE_DONE    2
+#define TILE_PARKED  3
+
+/*
+A connection.  It is freed when the connection is closed and every
+request on it has been answered, so the dispatcher never writes to
+a descriptor that was closed and reused.
+*/
+typedef struct client {
+	int fd;
+	int refs;	// the connection itself and each unanswered request
+	int closed;	// the client went away; write nothing more
+	char *out;	// replies the socket has not taken yet, from out_start to out_end
+	size_t out_start;
+	size_t out_end;
+	size_t out_size;
+	char line[REQUEST_MAX];
+	int len;
+	struct request *requests;
+} client;
+
+typedef struct request {
+	client *c;
+	long id;
+	int format;
+	long col;	// the grid column and row of the first pixel
+	long row;
+	int pending;	// tiles not yet sent or dropped
+	int cancelled;
+	const char *error;
+	viewport v;
+	struct request *next;	// on the client, or on the finished list
+} request;
+
+/* A request waiting for a tile. */
+typedef struct waiter {
+	request *r;
+	struct waiter *next;
+} waiter;
+
+/*
+A tile is known by its grid and its cell in it.  A grid is a pixel
+spacing, a fractal, and where pixels fall within a whole one, or for
+a view too far out, the corner of that view.
+*/
+typedef struct {
+	double dx;
+	double dy;
+	int aligned;
+	double phase_x;	// in 1/GRID_PHASE of a pixel, or the corner when not aligned
+	double phase_y;
+	int maxiter;
+	int fractal;
+	int power;
+	double kx;
+	double ky;
+	long col;	// the cell, counted in tiles
+	long row;
+} tile_key;
+
+/*
+A tile is computed in the viewport of its cell alone, which follows
+from its key, so what a request gets never depends on who asked first.
+*/
+typedef struct tile {
+	tile_key key;
+	viewport v;
+	int w;
+	int h;
+	int state;
+	int users;	// deliveries still to send from packed
+	unsigned char *packed;	// the counts, as tilecodec.h encodes them
+	size_t packed_size;
+	waiter *waiters;
+	struct tile *hash_next;
+	struct tile *next;	// in the queue, or in the cache when done
+} tile;
+
+/* A tile to send to a request, or with t NULL, one it will not get. */
+typedef struct delivery {
+	request *r;
+	tile *t;
+	struct delivery *next;
+} delivery;
+
+/* Everything here is under mutex. */
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t work;	// tiles queued, or something to send
+	tile *table[HASH_SIZE];
+	tile *queue;
+	tile *queue_tail;
+	tile *parked;		// queued tiles wanted only by clients with full queues
+	tile *cache;		// oldest first
+	tile *cache_tail;
+	int cached;
+	delivery *deliveries;
+	delivery *held;		// for clients with full queues
+	int resume;		// a queue drained or a request went away: retry the held and parked ones
+	request *finished;	// requests to answer with done or error
+	long computed, shared, hits, dropped;
+	size_t cache_bytes;	// the cached tiles encoded
+	size_t cache_counts;	// and how many counts they hold
+} server;
+
+static render_pool *pool;
+static render_opts opts;
+static int verbose;
+static int wake[2];	// the dispatcher wakes the main thread to watch a queue
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *alloc( size_t bytes )
+{
+	void *ptr = calloc(1, bytes);
+	if (!ptr) {
+		perror("calloc");
+		exit(1);
+	}
+	return ptr;
+}
+
+static unsigned long hash_bytes( unsigned long h, const void *data, size_t n )
+{
+	const unsigned char *p = data;
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ p[i]) * 1099511628211UL;
+	return h;
+}
+
+/* Hashed a field at a time, as the struct has padding. */
+
+static unsigned long tile_hash( const tile_key *k )
+{
+	unsigned long h = 14695981039346656037UL;
+	h = hash_bytes(h, &k->dx, sizeof(k->dx));
+	h = hash_bytes(h, &k->dy, sizeof(k->dy));
+	h = hash_bytes(h, &k->aligned, sizeof(k->aligned));
+	h = hash_bytes(h, &k->phase_x, sizeof(k->phase_x));
+	h = hash_bytes(h, &k->phase_y, sizeof(k->phase_y));
+	h = hash_bytes(h, &k->maxiter, sizeof(k->maxiter));
+	h = hash_bytes(h, &k->fractal, sizeof(k->fractal));
+	h = hash_bytes(h, &k->power, sizeof(k->power));
+	h = hash_bytes(h, &k->kx, sizeof(k->kx));
+	h = hash_bytes(h, &k->ky, sizeof(k->ky));
+	h = hash_bytes(h, &k->col, sizeof(k->col));
+	h = hash_bytes(h, &k->row, sizeof(k->row));
+	return h % HASH_SIZE;
+}
+
+static int same_key( const tile_key *a, const tile_key *b )
+{
+	return a->dx == b->dx && a->dy == b->dy && a->aligned == b->aligned && a->phase_x == b->phase_x &&
+		a->phase_y == b->phase_y && a->maxiter == b->maxiter && a->fractal == b->fractal &&
+		a->power == b->power && a->kx == b->kx && a->ky == b->ky && a->col == b->col && a->row == b->row;
+}
+
+/* Round a pixel spacing, so spacings that differ only in their last bits share a grid. */
+
+static double spacing( double d )
+{
+	int e;
+	double m = frexp(d, &e);
+	return ldexp(nearbyint(ldexp(m, SPACING_BITS)), e - SPACING_BITS);
+}
+
+/*
+Place the first pixel of a view of side pixels from lo to hi on the
+grid at spacing d: its grid position is *start pixels and *phase of
+GRID_PHASE past the origin.  Return 0 if the view is too far out.
+*/
+
+static int place( double lo, double hi, int side, double *d, long *start, double *phase )
+{
+	*d = spacing((hi - lo) / side);
+	double at = lo / *d;
+	if (!(fabs(at) < GRID_REACH))
+		return 0;
+
+	double whole = floor(at);
+	*phase = nearbyint((at - whole) * GRID_PHASE);
+	if (*phase == GRID_PHASE) {
+		whole++;
+		*phase = 0;
+	}
+	*start = (long)whole;
+	return 1;
+}
+
+/* The key of r's tiles, but for the cell, and where r starts on its grid. */
+
+static void request_grid( request *r, tile_key *k )
+{
+	const viewport *v = &r->v;
+	memset(k, 0, sizeof(*k));
+	k->aligned = place(v->xmin, v->xmax, v->width, &k->dx, &r->col, &k->phase_x) &&
+		place(v->ymin, v->ymax, v->height, &k->dy, &r->row, &k->phase_y);
+	if (!k->aligned) {
+		k->phase_x = v->xmin;
+		k->phase_y = v->ymin;
+		r->col = 0;
+		r->row = 0;
+	}
+	k->maxiter = v->maxiter;
+	k->fractal = v->fractal;
+	k->power = v->power;
+	k->kx = v->kx;
+	k->ky = v->ky;
+}
+
+/* The viewport of the cell of k: its pixels lie on the grid, whichever request placed them. */
+
+static void cell_view( const tile_key *k, viewport *v )
+{
+	double left = (double)k->col * SERVER_TILE, top = (double)k->row * SERVER_TILE;
+
+	memset(v, 0, sizeof(*v));
+	if (k->aligned) {
+		v->xmin = (left + k->phase_x / GRID_PHASE) * k->dx;
+		v->ymin = (top + k->phase_y / GRID_PHASE) * k->dy;
+	} else {
+		v->xmin = k->phase_x + left * k->dx;
+		v->ymin = k->phase_y + top * k->dy;
+	}
+	v->xmax = v->xmin + SERVER_TILE * k->dx;
+	v->ymax = v->ymin + SERVER_TILE * k->dy;
+	v->width = SERVER_TILE;
+	v->height = SERVER_TILE;
+	v->maxiter = k->maxiter;
+	v->fractal = k->fractal;
+	v->power = k->power;
+	v->kx = k->kx;
+	v->ky = k->ky;
+}
+
+/* Floor division, for cells left of and above the origin. */
+
+static long cell_of( long pixel )
+{
+	return pixel >= 0 ? pixel / SERVER_TILE : -((-pixel + SERVER_TILE - 1) / SERVER_TILE);
+}
+
+static void unhash( tile *t )
+{
+	tile **p = &server.table[tile_hash(&t->key)];
+	while (*p != t)
+		p = &(*p)->hash_next;
+	*p = t->hash_next;
+}
+
+static void free_tile( tile *t )
+{
+	free(t->packed);
+	free(t);
+}
+
+static void deliver( request *r, tile *t )
+{
+	delivery *d = alloc(sizeof(delivery));
+	d->r = r;
+	d->t = t;
+	d->next = server.deliveries;
+	server.deliveries = d;
+	if (t)
+		t->users++;
+}
+
+/* Drop one reference to c, closing and freeing it with the last.  Called with the mutex held. */
+
+static void release_client( client *c )
+{
+	if (--c->refs > 0)
+		return;
+	close(c->fd);
+	free(c->out);
+	free(c);
+}
+
+/* Forget a request that has been answered.  Called with the mutex held. */
+
+static void release_request( request *r )
+{
+	request **p = &r->c->requests;
+	while (*p && *p != r)
+		p = &(*p)->next;
+	if (*p)
+		*p = r->next;
+	release_client(r->c);
+	free(r);
+}
+
+static size_t queued( const client *c )
+{
+	return c->out_end - c->out_start;
+}
+
+/* Write as much of c's queue as its socket takes without blocking.  Called with the mutex held. */
+
+static void flush_client( client *c )
+{
+	while (queued(c) > 0 && !c->closed) {
+		ssize_t k = send(c->fd, c->out + c->out_start, queued(c), MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (k <= 0) {
+			c->closed = 1;
+			break;
+		}
+		c->out_start += k;
+	}
+	if (c->closed || queued(c) == 0)
+		c->out_start = c->out_end = 0;
+}
+
+/*
+Queue n bytes of reply for c and write what its socket takes.  If some
+is left, wake the main thread to write the rest once there is room.
+Called with the mutex held.
+*/
+
+static void queue_reply( client *c, const void *buf, size_t n )
+{
+	if (c->closed)
+		return;
+
+	if (c->out_end + n > c->out_size) {
+		memmove(c->out, c->out + c->out_start, queued(c));
+		c->out_end -= c->out_start;
+		c->out_start = 0;
+	}
+	if (c->out_end + n > c->out_size) {
+		size_t size = c->out_size ? c->out_size : 4096;
+		while (size < c->out_end + n)
+			size *= 2;
+		c->out = realloc(c->out, size);
+		if (!c->out) {
+			perror("realloc");
+			exit(1);
+		}
+		c->out_size = size;
+	}
+	memcpy(c->out + c->out_end, buf, n);
+	c->out_end += n;
+
+	flush_client(c);
+	if (queued(c) > 0 && write(wake[1], "", 1) < 0 && errno != EAGAIN) {
+		perror("write");
+		exit(1);
+	}
+}
+
+/*
+Queue t for r.  Called with the mutex held; it is let go while the
+tile is decoded, which a tile with users and a request with pending
+tiles outlive.
+*/
+
+static void send_tile( request *r, const tile *t )
+{
+	// Where the cell falls in r's image, and the part of it inside.
+	long left = t->key.col * SERVER_TILE - r->col;
+	long top = t->key.row * SERVER_TILE - r->row;
+	int x = left > 0 ? left : 0;
+	int y = top > 0 ? top : 0;
+	int w = (left + SERVER_TILE < r->v.width ? left + SERVER_TILE : r->v.width) - x;
+	int h = (top + SERVER_TILE < r->v.height ? top + SERVER_TILE : r->v.height) - y;
+
+	size_t pixels = (size_t)w * h;
+	size_t bytes = r->format == FORMAT_RGB ? pixels * 3 : pixels * 4;
+	char header[128];
+	int n = snprintf(header, sizeof(header), "tile %ld %d %d %d %d %zu\n", r->id, x, y, w, h, bytes);
+	unsigned char *reply = malloc(n + bytes);
+	unsigned char *data = reply + n;
+	int iters[SERVER_TILE * SERVER_TILE];
+
+	pthread_mutex_unlock(&server.mutex);
+	if (!reply) {
+		perror("malloc");
+		exit(1);
+	}
+
+	if (tile_decode(t->packed, t->packed_size, t->v.maxiter, iters, (size_t)t->w * t->h)) {
+		fprintf(stderr, "fractalserver: cached tile does not decode\n");
+		exit(1);
+	}
+
+	for (size_t p = 0; p < pixels; p++) {
+		int iter = iters[(y - top + p / w) * SERVER_TILE + x - left + p % w];
+		if (r->format == FORMAT_RGB) {
+			int red, green, blue;
+			color_point(iter, t->v.maxiter, &red, &green, &blue);
+			data[3 * p] = red;
+			data[3 * p + 1] = green;
+			data[3 * p + 2] = blue;
+		} else {
+			data[4 * p] = iter;
+			data[4 * p + 1] = iter >> 8;
+			data[4 * p + 2] = iter >> 16;
+			data[4 * p + 3] = iter >> 24;
+		}
+	}
+
+	memcpy(reply, header, n);
+	pthread_mutex_lock(&server.mutex);
+
+	queue_reply(r->c, reply, n + bytes);
+	free(reply);
+}
+
+/*
+Queue the deliveries and answers so far, holding back the tiles of
+clients with full queues.  Called with the mutex held.
+*/
+
+static void send_all()
+{
+	delivery *list = server.deliveries;
+	server.deliveries = NULL;
+
+	while (list) {
+		delivery *d = list;
+		request *r = d->r;
+		list = d->next;
+
+		if (d->t && !r->cancelled && !r->c->closed) {
+			if (queued(r->c) >= CLIENT_QUEUE) {
+				d->next = server.held;
+				server.held = d;
+				continue;
+			}
+			send_tile(r, d->t);
+		}
+
+		if (d->t)
+			d->t->users--;
+		if (--r->pending == 0) {
+			r->next = server.finished;
+			server.finished = r;
+		}
+		free(d);
+	}
+
+	while (server.finished) {
+		request *r = server.finished;
+		char line[REQUEST_MAX];
+		int n = r->error ? snprintf(line, sizeof(line), "error %ld %s\n", r->id, r->error) :
+			snprintf(line, sizeof(line), "done %ld\n", r->id);
+		server.finished = r->next;
+		queue_reply(r->c, line, n);
+		release_request(r);
+	}
+}
+
+/* Remember a finished tile, evicting the oldest unused ones. */
+
+static void cache_tile( tile *t )
+{
+	t->next = NULL;
+	if (server.cache_tail)
+		server.cache_tail->next = t;
+	else
+		server.cache = t;
+	server.cache_tail = t;
+	server.cached++;
+	server.cache_bytes += t->packed_size;
+	server.cache_counts += (size_t)t->w * t->h;
+
+	tile **p = &server.cache;
+	tile *prev = NULL;
+	while (server.cached > CACHE_TILES && *p) {
+		tile *old = *p;
+		if (old->users > 0) {
+			prev = old;
+			p = &old->next;
+			continue;
+		}
+		*p = old->next;
+		if (server.cache_tail == old)
+			server.cache_tail = prev;
+		unhash(old);
+		server.cached--;
+		server.cache_bytes -= old->packed_size;
+		server.cache_counts -= (size_t)old->w * old->h;
+		free_tile(old);
+	}
+}
+
+static int tile_wanted( const tile *t )
+{
+	for (const waiter *w = t->waiters; w; w = w->next) {
+		if (!w->r->cancelled && !w->r->c->closed)
+			return 1;
+	}
+	return 0;
+}
+
+/* Whether a client that wants t has room in its queue for it. */
+
+static int tile_sendable( const tile *t )
+{
+	for (const waiter *w = t->waiters; w; w = w->next) {
+		if (!w->r->cancelled && !w->r->c->closed && queued(w->r->c) < CLIENT_QUEUE)
+			return 1;
+	}
+	return 0;
+}
+
+/* Hand every waiter of t its tile, or with t dropped, its absence. */
+
+static void answer_waiters( tile *t, int dropped )
+{
+	while (t->waiters) {
+		waiter *w = t->waiters;
+		t->waiters = w->next;
+		deliver(w->r, dropped ? NULL : t);
+		free(w);
+	}
+}
+
+typedef struct {
+	tile **tiles;
+	int count;
+	int next;
+} batch;
+
+/* Compute and encode the tiles of a batch, a tile at a time on each worker. */
+
+static void compute_batch( void *arg, int thread )
+{
+	batch *b = (batch *)arg;
+	int iters[SERVER_TILE * SERVER_TILE];
+
+	while (1) {
+		int i = __sync_fetch_and_add(&b->next, 1);
+		if (i >= b->count)
+			break;
+		tile *t = b->tiles[i];
+		render_rect(&t->v, &opts, 0, 0, t->w, t->h, iters);
+
+		unsigned char *packed = malloc(tile_encode_bound(t->w * t->h, t->v.maxiter));
+		if (!packed) {
+			perror("malloc");
+			exit(1);
+		}
+		t->packed_size = tile_encode(iters, t->w * t->h, t->v.maxiter, packed);
+		t->packed = realloc(packed, t->packed_size);
+		if (!t->packed) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+}
+
+static void *dispatcher( void *arg )
+{
+	int max_batch = opts.num_threads * BATCH_PER_THREAD;
+	tile *tiles[max_batch];
+
+	pthread_mutex_lock(&server.mutex);
+	while (1) {
+		while (!server.queue && !server.deliveries && !server.finished && !server.resume)
+			pthread_cond_wait(&server.work, &server.mutex);
+
+		// Give the held and parked tiles another try, the parked ones in their old order.
+		if (server.resume) {
+			server.resume = 0;
+			while (server.held) {
+				delivery *d = server.held;
+				server.held = d->next;
+				d->next = server.deliveries;
+				server.deliveries = d;
+			}
+			while (server.parked) {
+				tile *t = server.parked;
+				server.parked = t->next;
+				t->state = TILE_QUEUED;
+				t->next = server.queue;
+				server.queue = t;
+				if (!server.queue_tail)
+					server.queue_tail = t;
+			}
+		}
+
+		// Take the next batch, dropping tiles nobody wants any more.
+		batch b = { tiles, 0, 0 };
+		while (server.queue && b.count < max_batch) {
+			tile *t = server.queue;
+			server.queue = t->next;
+			if (!server.queue)
+				server.queue_tail = NULL;
+
+			if (!tile_wanted(t)) {
+				answer_waiters(t, 1);
+				unhash(t);
+				free_tile(t);
+				server.dropped++;
+				continue;
+			}
+			// Nobody who wants it is reading, so it would only wait in a queue and hold up the rest.
+			if (!tile_sendable(t)) {
+				t->state = TILE_PARKED;
+				t->next = server.parked;
+				server.parked = t;
+				continue;
+			}
+			t->state = TILE_RUNNING;
+			tiles[b.count++] = t;
+		}
+
+		send_all();
+		if (b.count == 0)
+			continue;
+
+		pthread_mutex_unlock(&server.mutex);
+		double start = now();
+		render_pool_run(pool, 0, opts.num_threads, opts.pin, compute_batch, &b);
+		double wall = now() - start;
+		pthread_mutex_lock(&server.mutex);
+
+		for (int i = 0; i < b.count; i++) {
+			tile *t = tiles[i];
+			t->state = TILE_DONE;
+			answer_waiters(t, 0);
+			cache_tile(t);
+		}
+		server.computed += b.count;
+
+		if (verbose) {
+			fprintf(stderr, "batch: %d tiles in %.4fs; %ld computed, %ld shared, %ld from cache, %ld dropped\n",
+				b.count, wall, server.computed, server.shared, server.hits, server.dropped);
+			fprintf(stderr, "cache: %d tiles in %.1f KB, %.2f bits a count\n", server.cached,
+				server.cache_bytes / 1024.0, server.cache_bytes * 8.0 / server.cache_counts);
+		}
+	}
+
+	return NULL;
+}
+
+/* Queue the tiles of a new request, sharing any that are queued, running or cached. */
+
+static void add_request( request *r )
+{
+	const viewport *v = &r->v;
+	tile_key key;
+
+	request_grid(r, &key);
+	long first_col = cell_of(r->col), last_col = cell_of(r->col + v->width - 1);
+	long first_row = cell_of(r->row), last_row = cell_of(r->row + v->height - 1);
+	r->pending = (last_col - first_col + 1) * (last_row - first_row + 1);
+
+	for (key.row = first_row; key.row <= last_row; key.row++) {
+		for (key.col = first_col; key.col <= last_col; key.col++) {
+			tile **slot = &server.table[tile_hash(&key)];
+			tile *t = *slot;
+			while (t && !same_key(&t->key, &key))
+				t = t->hash_next;
+
+			if (t && t->state == TILE_DONE) {
+				deliver(r, t);
+				server.hits++;
+				continue;
+			}
+
+			if (t) {
+				server.shared++;
+				if (t->state == TILE_PARKED)
+					server.resume = 1;
+			} else {
+				t = alloc(sizeof(tile));
+				t->key = key;
+				cell_view(&key, &t->v);
+				t->w = SERVER_TILE;
+				t->h = SERVER_TILE;
+				t->state = TILE_QUEUED;
+				t->hash_next = *slot;
+				*slot = t;
+
+				if (server.queue_tail)
+					server.queue_tail->next = t;
+				else
+					server.queue = t;
+				server.queue_tail = t;
+			}
+
+			waiter *w = alloc(sizeof(waiter));
+			w->r = r;
+			w->next = t->waiters;
+			t->waiters = w;
+		}
+	}
+}
+
+/* Answer a request with an error, through the dispatcher like every other write. */
+
+static void reject( client *c, long id, const char *error )
+{
+	request *r = alloc(sizeof(request));
+	r->c = c;
+	r->id = id;
+	r->error = error;
+	c->refs++;
+	r->next = server.finished;
+	server.finished = r;
+}
+
+/* Handle one request line.  Called with the mutex held. */
+
+static void handle_line( client *c, char *line )
+{
+	char command[16], format[16], fractal[32];
+	long id = -1;
+	viewport v = { 0 };
+
+	if (sscanf(line, "%15s %ld", command, &id) < 2) {
+		reject(c, id, "expected: render id ... or cancel id");
+		return;
+	}
+
+	if (!strcmp(command, "cancel")) {
+		for (request *r = c->requests; r; r = r->next) {
+			if (r->id == id)
+				r->cancelled = 1;
+		}
+		if (server.held || server.parked)
+			server.resume = 1;
+		return;
+	}
+
+	strcpy(fractal, "mandelbrot");
+	v.power = 2;
+	int n = sscanf(line, "%*s %*d %lf %lf %lf %lf %d %d %d %15s %31s %d %lf %lf",
+		&v.xmin, &v.xmax, &v.ymin, &v.ymax, &v.width, &v.height, &v.maxiter, format, fractal, &v.power, &v.kx, &v.ky);
+	v.fractal = fractal_parse(fractal);
+
+	if (strcmp(command, "render") || (n != 8 && n != 12) ||
+	    (strcmp(format, "iter") && strcmp(format, "rgb")) ||
+	    v.width < 1 || v.height < 1 || v.width > MAX_SIDE || v.height > MAX_SIDE || v.maxiter < 1 ||
+	    v.fractal < 0 || v.power < 2 || v.power > MAX_POWER) {
+		reject(c, id, "bad request");
+		return;
+	}
+
+	request *r = alloc(sizeof(request));
+	r->c = c;
+	r->id = id;
+	r->format = strcmp(format, "rgb") ? FORMAT_ITER : FORMAT_RGB;
+	r->v = v;
+	r->next = c->requests;
+	c->requests = r;
+	c->refs++;
+	add_request(r);
+}
+
+/* Read what the client sent.  Return 0 once it has gone away. */
+
+static int read_client( client *c )
+{
+	char buf[4096];
+	ssize_t n = read(c->fd, buf, sizeof(buf));
+
+	if (n < 0 && (errno == EINTR || errno == EAGAIN))
+		return 1;
+	if (n <= 0)
+		return 0;
+
+	pthread_mutex_lock(&server.mutex);
+	for (ssize_t i = 0; i < n; i++) {
+		if (buf[i] != '\n') {
+			if (c->len < REQUEST_MAX - 1)
+				c->line[c->len++] = buf[i];
+			continue;
+		}
+		c->line[c->len] = 0;
+		if (c->len < REQUEST_MAX - 1)
+			handle_line(c, c->line);
+		else
+			reject(c, -1, "request too long");
+		c->len = 0;
+	}
+	pthread_cond_signal(&server.work);
+	pthread_mutex_unlock(&server.mutex);
+
+	return 1;
+}
+
+static int listen_unix( const char *path )
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd < 0) {
+		perror("socket");
+		exit(1);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: socket path too long\n", path);
+		exit(1);
+	}
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 64)) {
+		perror(path);
+		exit(1);
+	}
+	return fd;
+}
+
+static int listen_tcp( int port )
+{
+	struct sockaddr_in addr;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	int one = 1;
+
+	if (fd < 0) {
+		perror("socket");
+		exit(1);
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 64)) {
+		perror("bind");
+		exit(1);
+	}
+	return fd;
+}
+
+static void usage( const char *prog )
+{
+	fprintf(stderr,"usage: %s [-u socket path | -p tcp port] [-n threads] [-P precision] [-a] [-v]\n",prog);
+	exit(1);
+}
+
+int main( int argc, char *argv[] )
+{
+	const char *path = "fractal.sock";
+	int port = 0;
+	client *clients[MAX_CLIENTS];
+	int num_clients = 0;
+
+	render_opts_init(&opts, SCHED_TILE, render_default_threads());
+
+	int c;
+	while ((c = getopt(argc, argv, "u:p:n:P:av")) != -1) {
+		switch (c) {
+			case 'u':
+				path = optarg;
+				break;
+			case 'p':
+				port = atoi(optarg);
+				if (port < 1 || port > 65535)
+					usage(argv[0]);
+				break;
+			case 'n':
+				opts.num_threads = atoi(optarg);
+				if (opts.num_threads < 1 || opts.num_threads > MAX_THREADS)
+					usage(argv[0]);
+				break;
+			case 'P':
+				opts.precision = precision_parse(optarg);
+				if (opts.precision < 0)
+					usage(argv[0]);
+				break;
+			case 'a':
+				opts.pin = 1;
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		usage(argv[0]);
+
+	int listen_fd = port ? listen_tcp(port) : listen_unix(path);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (pipe2(wake, O_NONBLOCK)) {
+		perror("pipe2");
+		exit(1);
+	}
+
+	if (pthread_mutex_init(&server.mutex, NULL) || pthread_cond_init(&server.work, NULL)) {
+		perror("pthread_mutex_init");
+		exit(1);
+	}
+	pool = render_pool_create();
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, dispatcher, NULL)) {
+		perror("pthread_create");
+		exit(1);
+	}
+
+	if (port)
+		fprintf(stderr, "fractalserver: listening on 127.0.0.1:%d with %d threads\n", port, opts.num_threads);
+	else
+		fprintf(stderr, "fractalserver: listening on %s with %d threads\n", path, opts.num_threads);
+
+	while (1) {
+		struct pollfd fds[MAX_CLIENTS + 2];
+
+		// The last slot is the dispatcher's wake pipe, for queues it could not write out.
+		fds[0].fd = listen_fd;
+		fds[0].events = num_clients < MAX_CLIENTS ? POLLIN : 0;
+		pthread_mutex_lock(&server.mutex);
+		for (int i = 0; i < num_clients; i++) {
+			fds[i + 1].fd = clients[i]->fd;
+			fds[i + 1].events = POLLIN | (queued(clients[i]) > 0 ? POLLOUT : 0);
+		}
+		pthread_mutex_unlock(&server.mutex);
+		fds[num_clients + 1].fd = wake[0];
+		fds[num_clients + 1].events = POLLIN;
+
+		if (poll(fds, num_clients + 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			exit(1);
+		}
+
+		if (fds[num_clients + 1].revents & POLLIN) {
+			char buf[256];
+			while (read(wake[0], buf, sizeof(buf)) > 0)
+				;
+		}
+
+		// Read before accepting, so the indices still match the clients.
+		for (int i = num_clients - 1; i >= 0; i--) {
+			if (fds[i + 1].revents & POLLOUT) {
+				// Once a full queue drains, its held and parked tiles can go.
+				pthread_mutex_lock(&server.mutex);
+				flush_client(clients[i]);
+				if ((server.held || server.parked) && queued(clients[i]) < CLIENT_QUEUE) {
+					server.resume = 1;
+					pthread_cond_signal(&server.work);
+				}
+				pthread_mutex_unlock(&server.mutex);
+			}
+			if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			if (read_client(clients[i]))
+				continue;
+
+			// Gone: cancel its requests, and let the dispatcher free it once they are answered.
+			client *gone = clients[i];
+			clients[i] = clients[--num_clients];
+			pthread_mutex_lock(&server.mutex);
+			gone->closed = 1;
+			for (request *r = gone->requests; r; r = r->next)
+				r->cancelled = 1;
+			if (server.held || server.parked) {
+				server.resume = 1;
+				pthread_cond_signal(&server.work);
+			}
+			release_client(gone);
+			pthread_mutex_unlock(&server.mutex);
+		}
+
+		if (fds[0].revents & POLLIN) {
+			int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK);
+			if (fd >= 0) {
+				client *cl = alloc(sizeof(client));
+				cl->fd = fd;
+				cl->refs = 1;
+				clients[num_clients++] = cl;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,705 @@
+/*
+fractalzoom.c - Render a zoom sequence without a window.
+
+The camera follows a path of keyframes, each a time, a center and
+the width of the view in the plane.  Between keyframes the width
+changes exponentially and the center moves in step with the width,
+so the point being zoomed into stays put on the screen.
+
+Consecutive frames of a zoom mostly show the same part of the plane
+at nearly the same scale, so rather than computing every frame, a
+key image KEY_SCALE times the frame size is computed for a run of
+frames whose views all fit inside it at no less than one key pixel
+per frame pixel, and the frames are resampled from it.  For a steady
+zoom, keys are spaced a factor of KEY_SCALE apart in width.  With -d
+every frame is computed exactly instead.
+
+Keys go through a pipeline of three stages joined by queues:
+computing the iterations, coloring them, and resampling and writing
+the frames in order.  Several keys are computed at once, each on its
+own share of the worker pool, so while one key is finishing its last
+tiles the workers of the others are still busy, and neither coloring
+nor writing ever holds up the computing.  How many keys are in
+flight is limited by -J and by how many fit in the memory budget
+given with -M.  Frames go to numbered PPM files, or as raw 24 bit
+RGB to stdout, ready for e.g.
+	ffmpeg -f rawvideo -pix_fmt rgb24 -s 640x480 -r 30 -i - zoom.mp4
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "render.h"
+#include "stats.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define KEY_SCALE 2		// key images are this many times the frame size on each side
+#define IN_FLIGHT 2		// keys computed at once, by default
+#define MEMORY_MB 1024		// default budget for the keys in the pipeline
+#define MAX_KEYFRAMES 1024
+
+// The stages of the pipeline, for timing.
+#define STAGE_COMPUTE 0
+#define STAGE_COLOR   1
+#define STAGE_WRITE   2
+#define STAGE_COUNT   3
+
+/* A point on the camera path. */
+typedef struct {
+	double t;
+	double x;
+	double y;
+	double width;	// of the view, in the plane
+} keyframe;
+
+/* Without -k, zoom from the whole set into the "deep" view of fractalbench. */
+static const keyframe default_path[] = {
+	{ 0, -0.5,               0.0,               3.0 },
+	{ 1, -0.743643887037151, 0.131825904205330, 1e-5 },
+};
+
+/* A computed key image and the frames to resample from it. */
+typedef struct {
+	viewport v;
+	int *iters;
+	unsigned int *colors;
+	int colored;	// the compute stage already colored it, for antialiasing
+	int index;	// keys are numbered in frame order
+	int first;
+	int last;
+} zoom_key;
+
+/* Keys on their way from one stage to the next. */
+typedef struct {
+	zoom_key **keys;
+	int size;
+	int head;
+	int count;
+	int closed;	// no more keys will be pushed
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+} key_queue;
+
+/* One of the keys in flight in the compute stage, on its own workers. */
+typedef struct {
+	render_opts opts;
+	frame_stats *stats;
+	pthread_t thread;
+} compute_slot;
+
+/*
+The state the stages share.  Keys are planned in frame order by
+whichever compute slot is free, and are freed in the same order once
+written, so the keys in memory always have consecutive indices.
+There are never more than max_keys of them, which also bounds the
+queues between the stages.
+*/
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t freed;	// a key was written and freed
+	int next_frame;		// first frame of the next key to plan
+	int next_key;
+	int live_keys;
+	int max_keys;
+	int scale;
+	key_queue computed;	// to the coloring stage
+	key_queue colored;	// to the writer
+	double busy[STAGE_COUNT];	// seconds each stage spent working
+} zoom_pipeline;
+
+// Options shared by the stages.
+static int width = 640;
+static int height = 480;
+static const char *prefix;	// NULL for raw frames on stdout
+static viewport *frames;
+static int num_frames = 100;
+static zoom_pipeline pipeline;
+
+stats_output output;
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *alloc( size_t bytes )
+{
+	void *ptr = malloc(bytes);
+	if (!ptr) {
+		perror("malloc");
+		exit(1);
+	}
+	return ptr;
+}
+
+/*
+Read keyframes, one "t x y width" per line, in increasing t.
+Blank lines and lines starting with # are skipped.
+*/
+
+static int read_path( const char *path, keyframe *keys )
+{
+	FILE *file = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	char line[256];
+	int n = 0;
+
+	if (!file) {
+		perror(path);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		char *p = line + strspn(line, " \t");
+		if (*p == '#' || *p == '\n' || *p == 0)
+			continue;
+
+		keyframe *k = &keys[n];
+		if (n == MAX_KEYFRAMES || sscanf(p, "%lf %lf %lf %lf", &k->t, &k->x, &k->y, &k->width) != 4 ||
+		    k->width <= 0 || (n > 0 && k->t <= keys[n - 1].t)) {
+			fprintf(stderr, "%s: bad keyframe: %s", path, line);
+			exit(1);
+		}
+		n++;
+	}
+
+	if (file != stdin)
+		fclose(file);
+	return n;
+}
+
+/* Set v to where the path is at time t. */
+
+static void path_at( const keyframe *keys, int n, double t, const viewport *proto, viewport *v )
+{
+	int i = 0;
+	while (i + 2 < n && t > keys[i + 1].t)
+		i++;
+
+	const keyframe *a = &keys[i];
+	const keyframe *b = n > 1 ? &keys[i + 1] : a;
+	double s = b->t > a->t ? (t - a->t) / (b->t - a->t) : 0;
+	if (s < 0)
+		s = 0;
+	if (s > 1)
+		s = 1;
+
+	// The center moves linearly in the width, which keeps the zoom's fixed point still.
+	double w = a->width * pow(b->width / a->width, s);
+	double u = a->width != b->width ? (a->width - w) / (a->width - b->width) : s;
+	double x = a->x + (b->x - a->x) * u;
+	double y = a->y + (b->y - a->y) * u;
+	double h = w * proto->height / proto->width;
+
+	*v = *proto;
+	v->xmin = x - w / 2;
+	v->xmax = x + w / 2;
+	v->ymin = y - h / 2;
+	v->ymax = y + h / 2;
+}
+
+/*
+Starting at frame first, find the longest run of frames that one key
+can serve, and set key->v to cover them with KEY_SCALE times as many
+pixels as a frame on each side.  Return the last frame of the run.
+*/
+
+static int plan_key( const viewport *frames, int num_frames, int first, int scale, viewport *key )
+{
+	const viewport *f = &frames[first];
+	double xmin = f->xmin, xmax = f->xmax, ymin = f->ymin, ymax = f->ymax;
+	double min_width = f->xmax - f->xmin;
+	double aspect = (double)f->width / f->height;
+	int last = first;
+
+	if (scale == 1) {
+		*key = *f;
+		return first;
+	}
+
+	while (last + 1 < num_frames) {
+		const viewport *g = &frames[last + 1];
+		double x0 = fmin(xmin, g->xmin), x1 = fmax(xmax, g->xmax);
+		double y0 = fmin(ymin, g->ymin), y1 = fmax(ymax, g->ymax);
+		double w = fmin(min_width, g->xmax - g->xmin);
+
+		if (fmax(x1 - x0, (y1 - y0) * aspect) > scale * w)
+			break;
+
+		xmin = x0, xmax = x1, ymin = y0, ymax = y1;
+		min_width = w;
+		last++;
+	}
+
+	double kw = fmax(xmax - xmin, (ymax - ymin) * aspect);
+	double kh = kw / aspect;
+	double x = (xmin + xmax) / 2, y = (ymin + ymax) / 2;
+
+	*key = *f;
+	key->xmin = x - kw / 2;
+	key->xmax = x + kw / 2;
+	key->ymin = y - kh / 2;
+	key->ymax = y + kh / 2;
+	key->width = f->width * scale;
+	key->height = f->height * scale;
+	return last;
+}
+
+static void queue_init( key_queue *q, int size )
+{
+	memset(q, 0, sizeof(*q));
+	q->keys = alloc(size * sizeof(zoom_key *));
+	q->size = size;
+	if (pthread_mutex_init(&q->mutex, NULL) || pthread_cond_init(&q->changed, NULL)) {
+		perror("pthread_mutex_init");
+		exit(1);
+	}
+}
+
+/* Add a key, waiting while the queue is full.  NULL closes the queue. */
+
+static void queue_push( key_queue *q, zoom_key *key )
+{
+	pthread_mutex_lock(&q->mutex);
+	if (!key) {
+		q->closed = 1;
+	} else {
+		while (q->count == q->size)
+			pthread_cond_wait(&q->changed, &q->mutex);
+		q->keys[(q->head + q->count) % q->size] = key;
+		q->count++;
+	}
+	pthread_cond_broadcast(&q->changed);
+	pthread_mutex_unlock(&q->mutex);
+}
+
+/* Take the oldest key, waiting for one.  Return NULL once the queue is closed and empty. */
+
+static zoom_key *queue_pop( key_queue *q )
+{
+	zoom_key *key = NULL;
+
+	pthread_mutex_lock(&q->mutex);
+	while (q->count == 0 && !q->closed)
+		pthread_cond_wait(&q->changed, &q->mutex);
+	if (q->count > 0) {
+		key = q->keys[q->head];
+		q->head = (q->head + 1) % q->size;
+		q->count--;
+		pthread_cond_broadcast(&q->changed);
+	}
+	pthread_mutex_unlock(&q->mutex);
+
+	return key;
+}
+
+/* Return the color at key pixel u, v by bilinear interpolation, clamped to the image. */
+
+static void sample_key( const zoom_key *key, double u, double v, unsigned char *rgb )
+{
+	int kw = key->v.width, kh = key->v.height;
+	if (u < 0)
+		u = 0;
+	if (v < 0)
+		v = 0;
+	if (u > kw - 1)
+		u = kw - 1;
+	if (v > kh - 1)
+		v = kh - 1;
+
+	int i = (int)u, j = (int)v;
+	int i1 = i + 1 < kw ? i + 1 : i;
+	int j1 = j + 1 < kh ? j + 1 : j;
+	double fu = u - i, fv = v - j;
+	const unsigned int *row0 = key->colors + (size_t)j * kw;
+	const unsigned int *row1 = key->colors + (size_t)j1 * kw;
+
+	for (int c = 0; c < 3; c++) {
+		int shift = 16 - 8 * c;
+		double top = ((row0[i] >> shift) & 0xff) * (1 - fu) + ((row0[i1] >> shift) & 0xff) * fu;
+		double bottom = ((row1[i] >> shift) & 0xff) * (1 - fu) + ((row1[i1] >> shift) & 0xff) * fu;
+		rgb[c] = (unsigned char)(top * (1 - fv) + bottom * fv + 0.5);
+	}
+}
+
+/* Fill rgb with frame f, resampled from key. */
+
+static void resample( const zoom_key *key, const viewport *f, unsigned char *rgb )
+{
+	const viewport *k = &key->v;
+
+	// A key made for exactly this frame is copied, so -d output is exact.
+	if (k->width == f->width && k->height == f->height && k->xmin == f->xmin && k->xmax == f->xmax &&
+	    k->ymin == f->ymin && k->ymax == f->ymax) {
+		for (size_t p = 0; p < (size_t)f->width * f->height; p++) {
+			rgb[3 * p] = key->colors[p] >> 16;
+			rgb[3 * p + 1] = (key->colors[p] >> 8) & 0xff;
+			rgb[3 * p + 2] = key->colors[p] & 0xff;
+		}
+		return;
+	}
+
+	double kdx = (k->xmax - k->xmin) / k->width, kdy = (k->ymax - k->ymin) / k->height;
+	double fdx = (f->xmax - f->xmin) / f->width, fdy = (f->ymax - f->ymin) / f->height;
+
+	for (int j = 0; j < f->height; j++) {
+		double v = (f->ymin + j * fdy - k->ymin) / kdy;
+		for (int i = 0; i < f->width; i++) {
+			double u = (f->xmin + i * fdx - k->xmin) / kdx;
+			sample_key(key, u, v, rgb + 3 * ((size_t)j * f->width + i));
+		}
+	}
+}
+
+static void write_frame( int n, const unsigned char *rgb )
+{
+	size_t bytes = (size_t)width * height * 3;
+
+	if (!prefix) {
+		if (fwrite(rgb, 1, bytes, stdout) != bytes) {
+			perror("stdout");
+			exit(1);
+		}
+		return;
+	}
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s%05d.ppm", prefix, n);
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		perror(path);
+		exit(1);
+	}
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	if (fwrite(rgb, 1, bytes, file) != bytes || fclose(file)) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static void add_busy( int stage, double seconds )
+{
+	pthread_mutex_lock(&pipeline.mutex);
+	pipeline.busy[stage] += seconds;
+	pthread_mutex_unlock(&pipeline.mutex);
+}
+
+/*
+The compute stage: plan the next key, waiting while the memory
+budget is used up, and compute its iterations.  Keys that need
+antialiasing are colored here too, as the second pass needs colors.
+*/
+
+static void *compute_keys( void *arg )
+{
+	compute_slot *slot = (compute_slot *)arg;
+
+	while (1) {
+		pthread_mutex_lock(&pipeline.mutex);
+		while (pipeline.live_keys == pipeline.max_keys && pipeline.next_frame < num_frames)
+			pthread_cond_wait(&pipeline.freed, &pipeline.mutex);
+		if (pipeline.next_frame >= num_frames) {
+			pthread_mutex_unlock(&pipeline.mutex);
+			break;
+		}
+
+		zoom_key *key = alloc(sizeof(zoom_key));
+		key->index = pipeline.next_key++;
+		key->first = pipeline.next_frame;
+		key->last = plan_key(frames, num_frames, key->first, pipeline.scale, &key->v);
+		pipeline.next_frame = key->last + 1;
+		pipeline.live_keys++;
+		pthread_mutex_unlock(&pipeline.mutex);
+
+		size_t pixels = (size_t)key->v.width * key->v.height;
+		key->iters = alloc(pixels * sizeof(int));
+		key->colors = alloc(pixels * sizeof(unsigned int));
+		key->colored = slot->opts.aa_samples > 0;
+
+		double start = now();
+		render_image(&key->v, &slot->opts, key->iters, NULL, key->colored ? key->colors : NULL, NULL, NULL);
+		add_busy(STAGE_COMPUTE, now() - start);
+
+		if (slot->stats) {
+			pthread_mutex_lock(&pipeline.mutex);
+			stats_report(&output, slot->stats);
+			pthread_mutex_unlock(&pipeline.mutex);
+		}
+
+		queue_push(&pipeline.computed, key);
+	}
+
+	return NULL;
+}
+
+/* The coloring stage. */
+
+static void *color_keys( void *arg )
+{
+	zoom_key *key;
+
+	while ((key = queue_pop(&pipeline.computed))) {
+		double start = now();
+		if (!key->colored) {
+			for (size_t p = 0; p < (size_t)key->v.width * key->v.height; p++) {
+				int r, g, b;
+				color_point(key->iters[p], key->v.maxiter, &r, &g, &b);
+				key->colors[p] = r << 16 | g << 8 | b;
+			}
+		}
+		add_busy(STAGE_COLOR, now() - start);
+		queue_push(&pipeline.colored, key);
+	}
+
+	queue_push(&pipeline.colored, NULL);
+	return NULL;
+}
+
+/*
+The writer: resample and write the frames of each key in frame
+order.  Keys finish out of order when several are computed at once,
+so early arrivals wait in a ring indexed by key number until their
+turn; the keys in memory have consecutive numbers, so max_keys
+entries are enough.
+*/
+
+static void *write_frames( void *arg )
+{
+	unsigned char *rgb = alloc((size_t)width * height * 3);
+	zoom_key **waiting = calloc(pipeline.max_keys, sizeof(zoom_key *));
+	int next = 0;
+	zoom_key *key;
+
+	if (!waiting) {
+		perror("calloc");
+		exit(1);
+	}
+
+	while ((key = queue_pop(&pipeline.colored))) {
+		waiting[key->index % pipeline.max_keys] = key;
+
+		while ((key = waiting[next % pipeline.max_keys]) && key->index == next) {
+			waiting[next % pipeline.max_keys] = NULL;
+
+			double start = now();
+			for (int f = key->first; f <= key->last; f++) {
+				resample(key, &frames[f], rgb);
+				write_frame(f, rgb);
+			}
+			add_busy(STAGE_WRITE, now() - start);
+
+			free(key->iters);
+			free(key->colors);
+			free(key);
+			next++;
+
+			pthread_mutex_lock(&pipeline.mutex);
+			pipeline.live_keys--;
+			pthread_cond_broadcast(&pipeline.freed);
+			pthread_mutex_unlock(&pipeline.mutex);
+		}
+	}
+
+	if (!prefix)
+		fflush(stdout);
+	free(waiting);
+	free(rgb);
+	return NULL;
+}
+
+static void usage( const char *prog )
+{
+	fprintf(stderr,"usage: %s [-k keyframes] [-f frames] [-S WxH] [-m maxiter] [-o prefix] [-d] [-n threads] [-J keys] [-M MB]\n",prog);
+	fprintf(stderr,"       [-P precision] [-A samples] [-F fractal] [-N power] [-K kx,ky] [-v] [-l stats.csv|stats.json]\n");
+	fprintf(stderr,"keyframes: lines of \"t x y width\"; - for stdin\n");
+	exit(1);
+}
+
+int main( int argc, char *argv[] )
+{
+	keyframe path[MAX_KEYFRAMES];
+	int num_keyframes = 0;
+	int num_threads = render_default_threads();
+	int in_flight = IN_FLIGHT;
+	double memory_mb = MEMORY_MB;
+	int scale = KEY_SCALE;
+	viewport proto = { 0 };
+	render_opts opts;
+
+	proto.maxiter = 1000;
+	proto.fractal = FRACTAL_MANDELBROT;
+	proto.power = 2;
+	proto.kx = JULIA_KX;
+	proto.ky = JULIA_KY;
+	render_opts_init(&opts, SCHED_TILE, num_threads);
+
+	int c;
+	while ((c = getopt(argc, argv, "k:f:S:m:o:dn:J:M:P:A:F:N:K:vl:")) != -1) {
+		switch (c) {
+			case 'k':
+				num_keyframes = read_path(optarg, path);
+				break;
+			case 'f':
+				num_frames = atoi(optarg);
+				break;
+			case 'S':
+				if (sscanf(optarg, "%dx%d", &width, &height) != 2)
+					usage(argv[0]);
+				break;
+			case 'm':
+				proto.maxiter = atoi(optarg);
+				break;
+			case 'o':
+				prefix = optarg;
+				break;
+			case 'd':
+				scale = 1;
+				break;
+			case 'n':
+				num_threads = atoi(optarg);
+				break;
+			case 'J':
+				in_flight = atoi(optarg);
+				break;
+			case 'M':
+				memory_mb = atof(optarg);
+				break;
+			case 'P':
+				opts.precision = precision_parse(optarg);
+				if (opts.precision < 0)
+					usage(argv[0]);
+				break;
+			case 'A':
+				opts.aa_samples = atoi(optarg);
+				break;
+			case 'F':
+				proto.fractal = fractal_parse(optarg);
+				if (proto.fractal < 0)
+					usage(argv[0]);
+				break;
+			case 'N':
+				proto.power = atoi(optarg);
+				if (proto.power < 2 || proto.power > MAX_POWER)
+					usage(argv[0]);
+				break;
+			case 'K':
+				if (sscanf(optarg, "%lf,%lf", &proto.kx, &proto.ky) != 2)
+					usage(argv[0]);
+				break;
+			case 'v':
+				output.verbose = 1;
+				break;
+			case 'l':
+				stats_log_open(&output, optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind < argc || num_frames < 1 || width < 1 || height < 1 || proto.maxiter < 1 ||
+	    num_threads < 1 || num_threads > MAX_THREADS || in_flight < 1 || memory_mb <= 0 ||
+	    opts.aa_samples < 0 || opts.aa_samples > AA_MAX_SAMPLES)
+		usage(argv[0]);
+
+	if (!num_keyframes) {
+		num_keyframes = sizeof(default_path) / sizeof(default_path[0]);
+		memcpy(path, default_path, sizeof(default_path));
+	}
+	if (!prefix && isatty(STDOUT_FILENO)) {
+		fprintf(stderr, "%s: not writing raw frames to a terminal; redirect stdout or use -o\n", argv[0]);
+		exit(1);
+	}
+
+	proto.width = width;
+	proto.height = height;
+	frames = alloc(num_frames * sizeof(viewport));
+	for (int f = 0; f < num_frames; f++) {
+		double t0 = path[0].t, t1 = path[num_keyframes - 1].t;
+		double t = num_frames > 1 ? t0 + (t1 - t0) * f / (num_frames - 1) : t0;
+		path_at(path, num_keyframes, t, &proto, &frames[f]);
+	}
+
+	// Every key is the same size, so the budget is a number of keys, though never less than one.
+	double key_mb = (double)width * scale * height * scale * (sizeof(int) + sizeof(unsigned int)) / (1 << 20);
+	pipeline.max_keys = memory_mb / key_mb < num_frames ? memory_mb / key_mb : num_frames;
+	if (pipeline.max_keys < 1)
+		pipeline.max_keys = 1;
+	if (in_flight > pipeline.max_keys)
+		in_flight = pipeline.max_keys;
+	if (in_flight > num_threads)
+		in_flight = num_threads;
+	pipeline.scale = scale;
+
+	if (pthread_mutex_init(&pipeline.mutex, NULL) || pthread_cond_init(&pipeline.freed, NULL)) {
+		perror("pthread_mutex_init");
+		exit(1);
+	}
+	queue_init(&pipeline.computed, pipeline.max_keys);
+	queue_init(&pipeline.colored, pipeline.max_keys);
+
+	double start = now();
+	render_pool *pool = render_pool_create();
+	compute_slot slots[in_flight];
+	pthread_t colorer, writer;
+
+	if (pthread_create(&colorer, NULL, color_keys, NULL) || pthread_create(&writer, NULL, write_frames, NULL)) {
+		perror("pthread_create");
+		exit(1);
+	}
+
+	// Split the workers between the slots.
+	for (int i = 0; i < in_flight; i++) {
+		int first = num_threads * i / in_flight;
+		compute_slot *slot = &slots[i];
+
+		slot->opts = opts;
+		slot->opts.num_threads = num_threads * (i + 1) / in_flight - first;
+		slot->opts.pool = pool;
+		slot->opts.first_worker = first;
+		slot->stats = NULL;
+		if (output.verbose || output.log) {
+			slot->stats = alloc(sizeof(frame_stats));
+			slot->opts.stats = slot->stats;
+		}
+
+		if (pthread_create(&slot->thread, NULL, compute_keys, slot)) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	for (int i = 0; i < in_flight; i++) {
+		if (pthread_join(slots[i].thread, NULL)) {
+			perror("pthread_join");
+			exit(1);
+		}
+		free(slots[i].stats);
+	}
+	queue_push(&pipeline.computed, NULL);
+	if (pthread_join(colorer, NULL) || pthread_join(writer, NULL)) {
+		perror("pthread_join");
+		exit(1);
+	}
+
+	double wall = now() - start;
+	int num_keys = pipeline.next_key;
+	fprintf(stderr, "zoom: %d frames of %dx%d from %d keys, %.2f key pixels per frame pixel, %.2fs, %.1f frames/s\n",
+		num_frames, width, height, num_keys, (double)num_keys * scale * scale / num_frames,
+		wall, wall > 0 ? num_frames / wall : 0);
+	fprintf(stderr, "pipeline: %d keys in flight on %d threads, at most %d keys of %.1f MB in memory; "
+		"busy compute %.2fs color %.2fs write %.2fs\n",
+		in_flight, num_threads, pipeline.max_keys, key_mb,
+		pipeline.busy[STAGE_COMPUTE], pipeline.busy[STAGE_COLOR], pipeline.busy[STAGE_WRITE]);
+
+	render_pool_free(pool);
+	stats_log_close(&output);
+	free(frames);
+	return 0;
+}
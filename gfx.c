@@ -8,9 +8,17 @@ Version 3, 11/07/2012 - Now much faster at changing colors rapidly.
 Version 2, 9/23/2011 - Fixes a bug that could result in jerky animation.
 */
 
+#define _DEFAULT_SOURCE
+
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
 
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,6 +43,17 @@ static int saved_ypos = 0;
 static int saved_xsize = 0;
 static int saved_ysize = 0;
 
+/*
+The framebuffer is an XImage the caller draws into directly.
+When the server supports MIT-SHM and is on this machine, the image
+lives in shared memory and presenting it copies nothing over the socket.
+*/
+
+static XImage *gfx_fb_image = 0;
+static XShmSegmentInfo gfx_fb_shminfo;
+static int gfx_fb_is_shared = 0;
+static int gfx_fb_attach_failed = 0;
+
 /* Open a new graphics window. */
 
 void gfx_open( int width, int height, const char *title )
@@ -94,6 +113,22 @@ void gfx_point( int x, int y )
 	XDrawPoint(gfx_display,gfx_window,gfx_gc,x,y);
 }
 
+/* Fill the horizontal span from (x1,y) to (x2,y) inclusive. */
+
+void gfx_span( int x1, int x2, int y )
+{
+	if(x2<x1) return;
+	XFillRectangle(gfx_display,gfx_window,gfx_gc,x1,y,x2-x1+1,1);
+}
+
+/* Fill the w x h rectangle at (x,y). */
+
+void gfx_fill_rect( int x, int y, int w, int h )
+{
+	if(w<=0 || h<=0) return;
+	XFillRectangle(gfx_display,gfx_window,gfx_gc,x,y,w,h);
+}
+
 /* Draw a line from (x1,y1) to (x2,y2) */
 
 void gfx_line( int x1, int y1, int x2, int y2 )
@@ -145,27 +180,71 @@ void gfx_clear_color( int r, int g, int b )
 	XChangeWindowAttributes(gfx_display,gfx_window,CWBackPixel,&attr);
 }
 
+/*
+Handle one event: remember positions and sizes, and return the key or
+button it carries, GFX_RESIZE if the window changed size, GFX_MOTION
+if the pointer moved, or GFX_NO_EVENT if there is nothing for the caller.
+*/
+
+static int gfx_handle_event( XEvent *event )
+{
+	if(event->type==KeyPress) {
+		saved_xpos = event->xkey.x;
+		saved_ypos = event->xkey.y;
+
+		/* If the key sequence maps to one character, return that, Latin-1 ones above 127. */
+		KeySym symbol;
+		char str[4];
+		int r = XLookupString(&event->xkey,str,sizeof(str),&symbol,0);
+		if(r==1) return (unsigned char)str[0];
+
+		/* Special case for navigation keys, return codes above 129. */
+		if(symbol>=0xff50 && symbol<=0xff58) {
+			return 129 + (symbol-0xff50);
+		}
+
+	} else if(event->type==ButtonPress) {
+		saved_xpos = event->xkey.x;
+		saved_ypos = event->xkey.y;
+		return event->xbutton.button;
+	} else if(event->type==MotionNotify) {
+		/* Only the latest position matters, so skip to the last motion queued. */
+		while(XCheckTypedWindowEvent(gfx_display,gfx_window,MotionNotify,event));
+		saved_xpos = event->xmotion.x;
+		saved_ypos = event->xmotion.y;
+		return GFX_MOTION;
+	} else if(event->type==ConfigureNotify) {
+		if(event->xconfigure.width!=saved_xsize || event->xconfigure.height!=saved_ysize) {
+			saved_xsize = event->xconfigure.width;
+			saved_ysize = event->xconfigure.height;
+			return GFX_RESIZE;
+		}
+	}
+
+	return GFX_NO_EVENT;
+}
+
+/*
+Check for a key or button without blocking.  Only events already
+read from the connection are looked at, so this neither flushes
+nor waits on the server.  Other events are consumed, and resizes
+are remembered for gfx_xsize and gfx_ysize.
+*/
+
 int gfx_event_waiting()
 {
-       XEvent event;
+	XEvent event;
 
-       gfx_flush();
+	while(XEventsQueued(gfx_display,QueuedAfterReading)>0) {
+		XPeekEvent(gfx_display,&event);
+		if(event.type==KeyPress || event.type==ButtonPress) {
+			return 1;
+		}
+		XNextEvent(gfx_display,&event);
+		gfx_handle_event(&event);
+	}
 
-       while (1) {
-               if(XCheckMaskEvent(gfx_display,-1,&event)) {
-                       if(event.type==KeyPress) {
-                               XPutBackEvent(gfx_display,&event);
-                               return 1;
-                       } else if (event.type==ButtonPress) {
-                               XPutBackEvent(gfx_display,&event);
-                               return 1;
-                       } else {
-                               return 0;
-                       }
-               } else {
-                       return 0;
-               }
-       }
+	return 0;
 }
 
 /* Wait for the user to press a key or mouse button. */
@@ -179,32 +258,71 @@ int gfx_wait()
 	while(1) {
 		XNextEvent(gfx_display,&event);
 
-		if(event.type==KeyPress) {
-			saved_xpos = event.xkey.x;
-			saved_ypos = event.xkey.y;
-
-			/* If the key sequence maps to an ascii character, return that. */
-			KeySym symbol;
-			char str[4];
-			int r = XLookupString(&event.xkey,str,sizeof(str),&symbol,0);
-			if(r==1) return str[0];
-
-			/* Special case for navigation keys, return codes above 129. */
-			if(symbol>=0xff50 && symbol<=0xff58) {
-				return 129 + (symbol-0xff50);
-			}
-
-		} else if(event.type==ButtonPress) {
-			saved_xpos = event.xkey.x;
-			saved_ypos = event.xkey.y;
-			return event.xbutton.button;
-		} else if(event.type==ConfigureNotify) {
-			saved_xsize = event.xconfigure.width;
-			saved_ysize = event.xconfigure.height;
+		int c = gfx_handle_event(&event);
+		if(c!=GFX_NO_EVENT && c!=GFX_RESIZE && c!=GFX_MOTION) return c;
+	}
+}
+
+static double gfx_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1000.0 + ts.tv_nsec/1e6;
+}
+
+/*
+Wait up to timeout_ms milliseconds (forever if negative) for a key,
+a button, a resize, or for watch_fd (if not negative) to become
+readable.  Sleeps in poll() on the X connection, so an idle caller
+uses no cpu.
+*/
+
+int gfx_wait_timeout( int timeout_ms, int watch_fd )
+{
+	XEvent event;
+	double deadline = gfx_now() + timeout_ms;
+
+	gfx_flush();
+
+	while(1) {
+		while(XPending(gfx_display)) {
+			XNextEvent(gfx_display,&event);
+			int c = gfx_handle_event(&event);
+			if(c!=GFX_NO_EVENT) return c;
 		}
+
+		struct pollfd fds[2];
+		fds[0].fd = ConnectionNumber(gfx_display);
+		fds[0].events = POLLIN;
+		fds[1].fd = watch_fd;
+		fds[1].events = POLLIN;
+
+		int wait = -1;
+		if(timeout_ms>=0) {
+			wait = deadline - gfx_now();
+			if(wait<0) wait = 0;
+		}
+
+		int n = poll(fds,watch_fd>=0 ? 2 : 1,wait);
+		if(n<0) {
+			if(errno==EINTR) continue;
+			perror("gfx_wait_timeout: poll");
+			exit(1);
+		}
+		if(watch_fd>=0 && (fds[1].revents & POLLIN)) return GFX_FD_READY;
+		if(n==0) return GFX_TIMEOUT;
 	}
 }
 
+/* Ask for GFX_MOTION events from gfx_wait_timeout, or stop them. */
+
+void gfx_motion( int enable )
+{
+	long mask = StructureNotifyMask|KeyPressMask|ButtonPressMask;
+	if(enable) mask |= PointerMotionMask;
+	XSelectInput(gfx_display,gfx_window,mask);
+}
+
 /* Return the X and Y coordinates of the last event. */
 
 int gfx_xpos()
@@ -234,3 +352,130 @@ int gfx_ysize()
 	return saved_ysize;
 }
 
+
+/* Catch the error XShmAttach raises when the server can't reach our segment. */
+
+static int gfx_fb_error( Display *display, XErrorEvent *event )
+{
+	gfx_fb_attach_failed = 1;
+	return 0;
+}
+
+static XImage *gfx_fb_create_shared( Visual *visual, int depth, int width, int height )
+{
+	if(!XShmQueryExtension(gfx_display)) return 0;
+
+	XImage *image = XShmCreateImage(gfx_display,visual,depth,ZPixmap,0,&gfx_fb_shminfo,width,height);
+	if(!image) return 0;
+
+	gfx_fb_shminfo.shmid = shmget(IPC_PRIVATE,image->bytes_per_line*image->height,IPC_CREAT|0600);
+	if(gfx_fb_shminfo.shmid<0) {
+		XDestroyImage(image);
+		return 0;
+	}
+
+	gfx_fb_shminfo.shmaddr = image->data = shmat(gfx_fb_shminfo.shmid,0,0);
+	gfx_fb_shminfo.readOnly = False;
+
+	if(image->data==(char*)-1) {
+		shmctl(gfx_fb_shminfo.shmid,IPC_RMID,0);
+		image->data = 0;
+		XDestroyImage(image);
+		return 0;
+	}
+
+	gfx_fb_attach_failed = 0;
+	XSync(gfx_display,False);
+	int (*old_handler)(Display *, XErrorEvent *) = XSetErrorHandler(gfx_fb_error);
+	XShmAttach(gfx_display,&gfx_fb_shminfo);
+	XSync(gfx_display,False);
+	XSetErrorHandler(old_handler);
+
+	/* The segment goes away once both sides have detached. */
+	shmctl(gfx_fb_shminfo.shmid,IPC_RMID,0);
+
+	if(gfx_fb_attach_failed) {
+		shmdt(gfx_fb_shminfo.shmaddr);
+		image->data = 0;
+		XDestroyImage(image);
+		return 0;
+	}
+
+	return image;
+}
+
+static XImage *gfx_fb_create_plain( Visual *visual, int depth, int width, int height )
+{
+	char *data = malloc((size_t)width*height*4);
+	if(!data) return 0;
+
+	XImage *image = XCreateImage(gfx_display,visual,depth,ZPixmap,0,data,width,height,32,width*4);
+	if(!image) free(data);
+
+	return image;
+}
+
+/* Get a framebuffer of 0x00RRGGBB pixels, or 0 on displays that don't use that layout. */
+
+unsigned int *gfx_fb_get( int width, int height )
+{
+	if(gfx_fb_image && gfx_fb_image->width==width && gfx_fb_image->height==height) {
+		return (unsigned int *)gfx_fb_image->data;
+	}
+
+	gfx_fb_close();
+
+	Visual *visual = DefaultVisual(gfx_display,0);
+	int depth = DefaultDepth(gfx_display,0);
+	if(!gfx_fast_color_mode || (depth!=24 && depth!=32) || visual->red_mask!=0xff0000 || visual->green_mask!=0xff00 || visual->blue_mask!=0xff) {
+		return 0;
+	}
+
+	gfx_fb_image = gfx_fb_create_shared(visual,depth,width,height);
+	gfx_fb_is_shared = gfx_fb_image!=0;
+	if(!gfx_fb_image) gfx_fb_image = gfx_fb_create_plain(visual,depth,width,height);
+	if(!gfx_fb_image) return 0;
+
+	/* Rows must be packed for callers that index the pixels as width*y+x. */
+	if(gfx_fb_image->bits_per_pixel!=32 || gfx_fb_image->bytes_per_line!=width*4) {
+		gfx_fb_close();
+		return 0;
+	}
+
+	return (unsigned int *)gfx_fb_image->data;
+}
+
+/* Copy the w x h rectangle at x,y of the framebuffer to the window. */
+
+void gfx_fb_present( int x, int y, int w, int h )
+{
+	if(!gfx_fb_image) return;
+
+	if(gfx_fb_is_shared) {
+		XShmPutImage(gfx_display,gfx_window,gfx_gc,gfx_fb_image,x,y,x,y,w,h,False);
+	} else {
+		XPutImage(gfx_display,gfx_window,gfx_gc,gfx_fb_image,x,y,x,y,w,h);
+	}
+}
+
+int gfx_fb_shared()
+{
+	return gfx_fb_is_shared;
+}
+
+void gfx_fb_close()
+{
+	if(!gfx_fb_image) return;
+
+	if(gfx_fb_is_shared) {
+		/* Make sure the server is done with the segment before it goes away. */
+		XShmDetach(gfx_display,&gfx_fb_shminfo);
+		XSync(gfx_display,False);
+		shmdt(gfx_fb_shminfo.shmaddr);
+		gfx_fb_image->data = 0;
+	}
+
+	XDestroyImage(gfx_fb_image);
+	gfx_fb_image = 0;
+	gfx_fb_is_shared = 0;
+}
@@ -17,6 +17,12 @@ void gfx_open( int width, int height, const char *title );
 /* Draw a point at (x,y) */
 void gfx_point( int x, int y );
 
+/* Fill the horizontal span from (x1,y) to (x2,y) inclusive. */
+void gfx_span( int x1, int x2, int y );
+
+/* Fill the w x h rectangle at (x,y). */
+void gfx_fill_rect( int x, int y, int w, int h );
+
 /* Draw a line from (x1,y1) to (x2,y2) */
 void gfx_line( int x1, int y1, int x2, int y2 );
 
@@ -32,6 +38,26 @@ void gfx_clear_color( int red, int green, int blue );
 /* Wait for the user to press a key or mouse button. */
 int gfx_wait();
 
+/*
+Values gfx_wait_timeout returns besides keys and buttons.  Keys and
+buttons are never negative, a NUL key included, so these are.
+*/
+#define GFX_NO_EVENT -1
+#define GFX_RESIZE   -2
+#define GFX_FD_READY -3
+#define GFX_MOTION   -4
+#define GFX_TIMEOUT  -5
+
+/*
+Wait up to timeout_ms (forever if negative) for a key, a button,
+a change of window size, pointer motion if asked for with gfx_motion,
+or for watch_fd to be readable (-1 for none).
+*/
+int gfx_wait_timeout( int timeout_ms, int watch_fd );
+
+/* Report pointer motion as GFX_MOTION if enable is set. */
+void gfx_motion( int enable );
+
 /* Return the X and Y coordinates of the last event. */
 int gfx_xpos();
 int gfx_ypos();
@@ -46,4 +72,20 @@ int gfx_event_waiting();
 /* Flush all previous output to the window. */
 void gfx_flush();
 
+/*
+Get a width x height framebuffer of 0x00RRGGBB pixels, row by row,
+recreating it if the size changed.  Returns 0 if the display can't
+take that layout, in which case draw with gfx_point instead.
+*/
+unsigned int *gfx_fb_get( int width, int height );
+
+/* Show the w x h rectangle at x,y of the framebuffer in the window. */
+void gfx_fb_present( int x, int y, int w, int h );
+
+/* Return 1 if the framebuffer is shared with the X server (MIT-SHM). */
+int gfx_fb_shared();
+
+/* Release the framebuffer. */
+void gfx_fb_close();
+
 #endif
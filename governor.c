@@ -0,0 +1,252 @@
+/*
+governor.c - Hold interactive frames to a time budget.
+See governor.h for the interface.
+*/
+
+#define _GNU_SOURCE
+
+#include "governor.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+The quality levels from best to worst: the resolution is divided by
+1 << shift in each direction and maxiter by 1 << iter_shift.  Halving
+maxiter costs little once it resolves the boundary, so it comes before
+each drop in resolution.
+*/
+static const struct {
+	int shift;
+	int iter_shift;
+} levels[GOVERNOR_LEVELS] = {
+	{ 0, 0 }, { 0, 1 }, { 1, 0 }, { 1, 1 }, { 2, 0 }, { 2, 1 }, { 3, 1 }, { 3, 2 }, { 4, 2 }, { 4, 3 },
+};
+
+/*
+What an iteration costs in each precision relative to double, for
+guessing at a precision no frame has used yet.
+*/
+static const double precision_cost[PREC_COUNT] = { 1, 1, 1, 4 };
+
+/* A full-size color buffer that a lower resolution frame is scaled up into. */
+typedef struct {
+	const viewport *v;
+	unsigned int *colors;
+	render_draw_t draw;
+	void *arg;
+	int scale;
+} scaled_target;
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void governor_init( governor *g, double budget )
+{
+	memset(g, 0, sizeof(*g));
+	g->budget = budget;
+}
+
+void governor_free( governor *g )
+{
+	for (int i = 0; i < GOVERNOR_SCALES; i++)
+		render_buffer_free(&g->low[i]);
+}
+
+int governor_pending( const governor *g )
+{
+	return g->pending;
+}
+
+int governor_shallow( const governor *g )
+{
+	return levels[g->level].iter_shift > 0;
+}
+
+/* The viewport level renders for v: fewer pixels, each covering scale of v's. */
+
+static void level_viewport( const viewport *v, int level, viewport *lv )
+{
+	int scale = 1 << levels[level].shift;
+
+	*lv = *v;
+	lv->width = (v->width + scale - 1) / scale;
+	lv->height = (v->height + scale - 1) / scale;
+	lv->xmax = v->xmin + (v->xmax - v->xmin) * lv->width * scale / v->width;
+	lv->ymax = v->ymin + (v->ymax - v->ymin) * lv->height * scale / v->height;
+	lv->maxiter = v->maxiter >> levels[level].iter_shift;
+	if (lv->maxiter < 1)
+		lv->maxiter = 1;
+}
+
+/*
+Pixels that reached maxiter last frame take all of it again, those
+filled in distance mode nothing, and the others their mean, unless
+maxiter now stops them sooner.
+Drawing costs the same at every level, as the frame is scaled up to
+full size before it is drawn.
+*/
+
+static double predict( const governor *g, const viewport *v, const render_opts *o, int level )
+{
+	viewport lv;
+	level_viewport(v, level, &lv);
+
+	// Coarser pixels and a lower maxiter can each change the precision.
+	int precision = render_precision(&lv, o->precision);
+	double unit = g->unit_cost[precision];
+	for (int p = 1; p < PREC_COUNT && unit == 0; p++)
+		unit = g->unit_cost[p] / precision_cost[p] * precision_cost[precision];
+
+	double escape = g->mean_escape < lv.maxiter ? g->mean_escape : lv.maxiter;
+	double computed = 1 - g->filled;
+	double iters = g->inside * lv.maxiter + (computed - g->inside) * escape;
+
+	return unit * lv.width * lv.height * (computed * GOVERNOR_PIXEL_ITERS + iters) + g->draw_cost * v->width * v->height;
+}
+
+static int choose_level( const governor *g, const viewport *v, const render_opts *o )
+{
+	// With nothing measured yet, the cheapest level is the only safe one.
+	if (!g->measured)
+		return GOVERNOR_LEVELS - 1;
+
+	for (int level = 0; level < GOVERNOR_LEVELS - 1; level++) {
+		if (predict(g, v, o, level) <= g->budget * GOVERNOR_MARGIN)
+			return level;
+	}
+	return GOVERNOR_LEVELS - 1;
+}
+
+/* Take the costs of the frame s measured of v, unless antialiasing muddled them. */
+
+static void measure( governor *g, const viewport *v, const frame_stats *s )
+{
+	double pixels = (double)s->v.width * s->v.height;
+	// Pixels filled in distance mode have 0 iterations, and neither escaped nor reached maxiter.
+	double inside = s->samples - s->escaped;
+	double draw = 0;
+
+	if (s->aa_samples || pixels <= 0 || s->samples <= 0)
+		return;
+
+	// Draws are serialized, so their times add up to the frame's.
+	for (int i = 0; i < s->num_threads; i++)
+		draw += s->threads[i].draw;
+	if (draw > s->wall)
+		draw = s->wall;
+
+	g->unit_cost[s->precision] = (s->wall - draw) / (s->samples * GOVERNOR_PIXEL_ITERS + s->iters);
+	g->draw_cost = draw / ((double)v->width * v->height);
+	g->inside = inside / pixels;
+	g->filled = (pixels - s->samples) / pixels;
+	g->mean_escape = s->escaped ? (s->iters - inside * s->v.maxiter) / s->escaped : 0;
+	if (g->mean_escape < 0)
+		g->mean_escape = 0;
+	g->measured = 1;
+}
+
+/* A render_draw_t that scales the finished rectangle up into the full-size buffer. */
+
+static void draw_scaled( const viewport *lv, const unsigned int *colors, int x, int y, int w, int h, void *arg )
+{
+	scaled_target *t = (scaled_target *)arg;
+	int s = t->scale;
+	int x0 = x * s, y0 = y * s;
+	int x1 = (x + w) * s < t->v->width ? (x + w) * s : t->v->width;
+	int y1 = (y + h) * s < t->v->height ? (y + h) * s : t->v->height;
+
+	// Widen each row once, then copy it down the rows it covers.
+	for (int j = y0; j < y1; j += s) {
+		const unsigned int *src = colors + (size_t)(j / s) * lv->width;
+		unsigned int *dst = t->colors + (size_t)j * t->v->width;
+		for (int i = x; i < x + w; i++) {
+			for (int k = i * s; k < (i + 1) * s && k < x1; k++)
+				dst[k] = src[i];
+		}
+		for (int k = j + 1; k < j + s && k < y1; k++)
+			memcpy(t->colors + (size_t)k * t->v->width + x0, dst + x0, (x1 - x0) * sizeof(unsigned int));
+	}
+
+	if (t->draw)
+		t->draw(t->v, t->colors, x0, y0, x1 - x0, y1 - y0, t->arg);
+}
+
+static float *buffer_dist( render_buffer *b, const viewport *v, const render_opts *o )
+{
+	if (o->distance && !b->dist) {
+		b->dist = malloc((size_t)v->width * v->height * sizeof(float));
+		if (!b->dist) {
+			perror("malloc");
+			exit(1);
+		}
+	}
+	return b->dist;
+}
+
+void governor_render( governor *g, const viewport *v, const render_opts *o, int interactive,
+	render_buffer *b, unsigned int *colors, render_draw_t draw, void *arg )
+{
+	double start = now();
+	render_opts go = *o;
+	int level = interactive ? choose_level(g, v, o) : 0;
+
+	if (!go.stats)
+		go.stats = &g->stats;
+	// Antialiasing waits for the refinement.
+	if (interactive)
+		go.aa_samples = 0;
+
+	if (level == 0) {
+		int *iters = render_buffer_get(b, v, &go);
+		render_image(v, &go, iters, buffer_dist(b, v, &go), colors, draw, arg);
+	} else {
+		viewport lv;
+		render_buffer *low = &g->low[levels[level].shift];
+		level_viewport(v, level, &lv);
+
+		int *iters = render_buffer_get(low, &lv, &go);
+		if (!low->colors) {
+			low->colors = malloc((size_t)lv.width * lv.height * sizeof(unsigned int));
+			if (!low->colors) {
+				perror("malloc");
+				exit(1);
+			}
+		}
+
+		scaled_target target = { v, colors, draw, arg, 1 << levels[level].shift };
+		render_image(&lv, &go, iters, buffer_dist(low, &lv, &go), low->colors, draw_scaled, &target);
+	}
+
+	measure(g, v, go.stats);
+
+	// A full quality frame without its antialiasing still wants refining.
+	g->level = level;
+	g->pending = interactive && (level > 0 || o->aa_samples > 0);
+
+	if (interactive) {
+		double elapsed = now() - start;
+		g->frames++;
+		if (elapsed > g->budget)
+			g->late++;
+		if (elapsed > g->worst)
+			g->worst = elapsed;
+	}
+}
+
+void governor_window( governor *g, const viewport *v, const render_opts *o, int interactive, render_buffer *b, int use_fb )
+{
+	render_draw_t draw;
+
+	// The window's buffer is sized for full resolution whatever the level.
+	render_buffer_get(b, v, o);
+	unsigned int *colors = render_window_colors(b, use_fb, &draw);
+
+	governor_render(g, v, o, interactive, b, colors, draw, NULL);
+}
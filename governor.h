@@ -0,0 +1,72 @@
+/*
+governor.h - Hold interactive frames to a time budget.
+
+While the view is moving, each frame is rendered at the best quality
+level predicted to finish within the budget: full resolution, then
+half maxiter, then down to a sixteenth of the resolution in each
+direction and an eighth of maxiter, scaled back up to the window in
+blocks.  The prediction comes from the last frame: the time it took
+per pixel and iteration, its drawing, and how many of its pixels
+escaped and how early.  Once input goes idle, the view is refined
+with one frame at full quality, antialiasing included.
+*/
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include "render.h"
+
+#define GOVERNOR_LEVELS 10	/* quality levels, 0 being full quality */
+#define GOVERNOR_SCALES 5	/* resolutions, 1 to 1 << (GOVERNOR_SCALES - 1) */
+#define GOVERNOR_MARGIN 0.75	/* aim for this fraction of the budget */
+#define GOVERNOR_PIXEL_ITERS 16	/* the cost of a pixel beyond its iterations, in iterations */
+#define GOVERNOR_IDLE_MS 150	/* how long input must pause before refining */
+
+typedef struct {
+	double budget;		/* seconds an interactive frame may take */
+	int level;		/* of the last frame */
+	int pending;		/* the last frame is to be refined */
+
+	/* What the last frame measured, for predicting the next. */
+	int measured;
+	double unit_cost[PREC_COUNT];	/* seconds per pixel and iteration computed, 0 if unknown */
+	double draw_cost;	/* seconds per pixel drawn */
+	double inside;		/* the fraction of pixels that reached maxiter */
+	double filled;		/* the fraction filled in distance mode without iterating */
+	double mean_escape;	/* the mean iterations of the others */
+
+	/* Interactive frames, those over budget, and the slowest. */
+	long frames;
+	long late;
+	double worst;
+
+	frame_stats stats;	/* used when the caller's options have none */
+	render_buffer low[GOVERNOR_SCALES];	/* iterations and colors below full resolution */
+} governor;
+
+void governor_init( governor *g, double budget );
+void governor_free( governor *g );
+
+/*
+Render v into colors, the full-size color buffer, calling draw
+with arg as rectangles of it finish.  b holds the iterations of full
+resolution frames.  An interactive frame is rendered at the level
+predicted to meet the budget, and any other frame at full quality.
+*/
+void governor_render( governor *g, const viewport *v, const render_opts *o, int interactive,
+	render_buffer *b, unsigned int *colors, render_draw_t draw, void *arg );
+
+/* The same for the gfx window, through the framebuffer if use_fb and the display allow it. */
+void governor_window( governor *g, const viewport *v, const render_opts *o, int interactive, render_buffer *b, int use_fb );
+
+/* Return 1 if the last frame was below full quality, to be refined once input goes idle. */
+int governor_pending( const governor *g );
+
+/*
+Return 1 if the last frame ran at a lower maxiter than it was asked
+for.  Its stats then describe that maxiter, and render_auto_maxiter
+would take them for the depth the view needs.
+*/
+int governor_shallow( const governor *g );
+
+#endif
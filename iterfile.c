@@ -0,0 +1,283 @@
+/*
+iterfile.c - Rendered frames saved as raw iteration counts.
+See iterfile.h for the format.
+*/
+
+#define _GNU_SOURCE
+
+#include "iterfile.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint64_t align( uint64_t offset )
+{
+	return (offset + ITERFILE_ALIGN - 1) / ITERFILE_ALIGN * ITERFILE_ALIGN;
+}
+
+static void setup( iterfile *f )
+{
+	const iterfile_header *h = &f->h;
+	viewport v = { h->xmin, h->xmax, h->ymin, h->ymax, h->width, h->height, h->maxiter,
+		h->fractal, h->power, h->kx, h->ky };
+
+	f->v = v;
+	f->tiles_x = (h->width + h->tile_size - 1) / h->tile_size;
+	f->tiles_y = (h->height + h->tile_size - 1) / h->tile_size;
+}
+
+static void write_at( iterfile *f, const void *buf, size_t n, uint64_t offset )
+{
+	const char *p = buf;
+
+	while (n > 0) {
+		ssize_t k = pwrite(f->fd, p, n, offset);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0) {
+			perror("pwrite");
+			exit(1);
+		}
+		p += k;
+		n -= k;
+		offset += k;
+	}
+}
+
+void iterfile_create( iterfile *f, const char *path, const viewport *v, int precision, int tile_size, int with_dist )
+{
+	iterfile_header *h = &f->h;
+
+	memset(f, 0, sizeof(*f));
+	memcpy(h->magic, ITERFILE_MAGIC, sizeof(h->magic));
+	h->version = ITERFILE_VERSION;
+	h->flags = with_dist ? ITERFILE_DIST : 0;
+	h->width = v->width;
+	h->height = v->height;
+	h->tile_size = tile_size > 0 ? tile_size : TASK_SIZE;
+	// A larger tile would be the same single tile.
+	if (h->tile_size > h->width && h->tile_size > h->height)
+		h->tile_size = h->width > h->height ? h->width : h->height;
+	h->maxiter = v->maxiter;
+	h->fractal = v->fractal;
+	h->power = v->power ? v->power : 2;
+	h->precision = precision;
+	h->xmin = v->xmin;
+	h->xmax = v->xmax;
+	h->ymin = v->ymin;
+	h->ymax = v->ymax;
+	h->kx = v->kx;
+	h->ky = v->ky;
+	setup(f);
+
+	uint64_t pixels = (uint64_t)v->width * v->height;
+	h->tiles_offset = align(sizeof(iterfile_header));
+	h->iters_offset = align(h->tiles_offset + (uint64_t)f->tiles_x * f->tiles_y);
+	h->dist_offset = with_dist ? align(h->iters_offset + pixels * sizeof(int32_t)) : 0;
+	h->size = with_dist ? h->dist_offset + pixels * sizeof(float) : h->iters_offset + pixels * sizeof(int32_t);
+
+	f->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (f->fd < 0) {
+		perror(path);
+		exit(1);
+	}
+
+	// The sections start out as holes, so the tile flags read as unwritten.
+	if (ftruncate(f->fd, h->size)) {
+		perror(path);
+		exit(1);
+	}
+	write_at(f, h, sizeof(*h), 0);
+
+	f->writing = 1;
+	f->filled = calloc((size_t)f->tiles_x * f->tiles_y, sizeof(int));
+	if (!f->filled) {
+		perror("calloc");
+		exit(1);
+	}
+}
+
+size_t iterfile_index( const iterfile *f, int x, int y )
+{
+	int size = f->h.tile_size;
+	int tx = x / size;
+	int ty = y / size;
+	int tw = (tx + 1) * size <= (int)f->h.width ? size : f->h.width - tx * size;
+	int th = (ty + 1) * size <= (int)f->h.height ? size : f->h.height - ty * size;
+	size_t start = (size_t)ty * size * f->h.width + (size_t)tx * size * th;
+
+	return start + (size_t)(y - ty * size) * tw + (x - tx * size);
+}
+
+/*
+Each tile the rectangle touches takes the rows of it that fall in
+the tile, gathered into one block when they are whole tile rows, so
+a rectangle that is a whole tile is a single write.
+*/
+
+void iterfile_write( iterfile *f, int x, int y, int w, int h, const int *iters, const float *dist, size_t stride )
+{
+	int size = f->h.tile_size;
+	int with_dist = dist && (f->h.flags & ITERFILE_DIST);
+	int32_t *block = malloc((size_t)size * size * sizeof(int32_t));
+	float *dblock = malloc((size_t)size * size * sizeof(float));
+
+	if (!block || !dblock) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (int ty = y / size; ty * size < y + h; ty++) {
+		for (int tx = x / size; tx * size < x + w; tx++) {
+			int x0 = tx * size > x ? tx * size : x;
+			int y0 = ty * size > y ? ty * size : y;
+			int x1 = (tx + 1) * size < x + w ? (tx + 1) * size : x + w;
+			int y1 = (ty + 1) * size < y + h ? (ty + 1) * size : y + h;
+			int tw = (tx + 1) * size <= (int)f->h.width ? size : f->h.width - tx * size;
+			int n = x1 - x0;
+
+			// Whole tile rows are contiguous in the file, and so is a run of them.
+			int whole = x0 == tx * size && n == tw;
+			for (int j = y0; j < y1; ) {
+				int rows = whole ? y1 - j : 1;
+				for (int r = 0; r < rows; r++) {
+					size_t src = (size_t)(j + r - y) * stride + (x0 - x);
+					memcpy(block + (size_t)r * n, iters + src, n * sizeof(int32_t));
+					if (with_dist)
+						memcpy(dblock + (size_t)r * n, dist + src, n * sizeof(float));
+				}
+
+				size_t index = iterfile_index(f, x0, j);
+				write_at(f, block, (size_t)rows * n * sizeof(int32_t), f->h.iters_offset + index * sizeof(int32_t));
+				if (with_dist)
+					write_at(f, dblock, (size_t)rows * n * sizeof(float), f->h.dist_offset + index * sizeof(float));
+				j += rows;
+			}
+
+			// The writer that completes a tile flags it, after its pixels are written.
+			int th = (ty + 1) * size <= (int)f->h.height ? size : f->h.height - ty * size;
+			int t = ty * f->tiles_x + tx;
+			if (__sync_add_and_fetch(&f->filled[t], n * (y1 - y0)) == tw * th) {
+				unsigned char one = 1;
+				write_at(f, &one, 1, f->h.tiles_offset + t);
+			}
+		}
+	}
+
+	free(block);
+	free(dblock);
+}
+
+void iterfile_draw( const viewport *v, const unsigned int *colors, int x, int y, int w, int h, void *arg )
+{
+	iterfile_sink *sink = (iterfile_sink *)arg;
+	size_t start = (size_t)y * v->width + x;
+
+	iterfile_write(sink->f, x, y, w, h, sink->iters + start, sink->dist ? sink->dist + start : NULL, v->width);
+}
+
+/* Whether a section of bytes at offset is aligned and lies within a file of size bytes. */
+
+static int inside( uint64_t offset, uint64_t bytes, uint64_t size )
+{
+	return offset % ITERFILE_ALIGN == 0 && offset >= align(sizeof(iterfile_header)) &&
+		offset <= size && bytes <= size - offset;
+}
+
+static uint32_t swap32( uint32_t x )
+{
+	return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+void iterfile_open( iterfile *f, const char *path )
+{
+	struct stat st;
+
+	memset(f, 0, sizeof(*f));
+	f->fd = open(path, O_RDONLY);
+	if (f->fd < 0 || fstat(f->fd, &st)) {
+		perror(path);
+		exit(1);
+	}
+
+	const iterfile_header *h = NULL;
+	if ((size_t)st.st_size >= sizeof(iterfile_header)) {
+		f->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, f->fd, 0);
+		if (f->map == MAP_FAILED) {
+			perror(path);
+			exit(1);
+		}
+		h = (const iterfile_header *)f->map;
+	}
+
+	if (h && !memcmp(h->magic, ITERFILE_MAGIC, sizeof(h->magic)) && swap32(h->version) == ITERFILE_VERSION) {
+		fprintf(stderr, "%s: written on a machine of the other byte order\n", path);
+		exit(1);
+	}
+
+	// Sizes that keep the tile arithmetic within an int.
+	if (!h || memcmp(h->magic, ITERFILE_MAGIC, sizeof(h->magic)) || h->version != ITERFILE_VERSION ||
+	    h->size != (uint64_t)st.st_size || h->width < 1 || h->height < 1 ||
+	    h->width > INT_MAX / 2 || h->height > INT_MAX / 2 ||
+	    h->tile_size < 1 || (h->tile_size > h->width && h->tile_size > h->height)) {
+		fprintf(stderr, "%s: not an iteration file\n", path);
+		exit(1);
+	}
+
+	f->h = *h;
+	setup(f);
+
+	uint64_t pixels = (uint64_t)h->width * h->height;
+	if (!inside(h->tiles_offset, (uint64_t)f->tiles_x * f->tiles_y, h->size) ||
+	    !inside(h->iters_offset, pixels * sizeof(int32_t), h->size) ||
+	    ((h->flags & ITERFILE_DIST) && !inside(h->dist_offset, pixels * sizeof(float), h->size))) {
+		fprintf(stderr, "%s: a section lies outside the file\n", path);
+		exit(1);
+	}
+	f->tiles = f->map + h->tiles_offset;
+	f->iters = (const int32_t *)(f->map + h->iters_offset);
+	f->dist = h->flags & ITERFILE_DIST ? (const float *)(f->map + h->dist_offset) : NULL;
+}
+
+void iterfile_close( iterfile *f )
+{
+	if (f->map)
+		munmap(f->map, f->h.size);
+	if (close(f->fd)) {
+		perror("close");
+		exit(1);
+	}
+	free(f->filled);
+	memset(f, 0, sizeof(*f));
+}
+
+int iterfile_tile_done( const iterfile *f, int tx, int ty )
+{
+	return f->tiles[ty * f->tiles_x + tx];
+}
+
+void iterfile_read( const iterfile *f, int x, int y, int w, int h, int *iters, float *dist, size_t stride )
+{
+	int size = f->h.tile_size;
+
+	// Runs of a row that fall in one tile are contiguous.
+	for (int j = 0; j < h; j++) {
+		for (int i = 0; i < w; ) {
+			int n = size - (x + i) % size;
+			if (n > w - i)
+				n = w - i;
+			size_t index = iterfile_index(f, x + i, y + j);
+			memcpy(iters + (size_t)j * stride + i, f->iters + index, n * sizeof(int));
+			if (dist && f->dist)
+				memcpy(dist + (size_t)j * stride + i, f->dist + index, n * sizeof(float));
+			i += n;
+		}
+	}
+}
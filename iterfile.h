@@ -0,0 +1,131 @@
+/*
+iterfile.h - Rendered frames saved as raw iteration counts.
+
+An iteration file keeps what a render computed rather than the colors
+made from it, so a frame can be colored again, cropped, downsampled
+or compared with another long after it was computed.  All numbers are
+in the byte order of the machine that wrote the file, which a reader
+of the other order refuses, and every section starts on an
+ITERFILE_ALIGN boundary so it can be mapped and used in place:
+
+	the header	an iterfile_header, padded to ITERFILE_ALIGN
+	tile flags	one byte per tile, 1 once all its pixels are written
+	iterations	width*height int32, tile by tile
+	distances	width*height float32 in the same order, if ITERFILE_DIST
+
+The image is cut into tile_size squares, smaller along the right and
+bottom edges, with tile_size no more than the image's larger side.
+The tiles are stored in rows from the top left.  The pixels of each
+tile are stored row by row, so a tile is one contiguous block, and the
+tile at tx, ty starts at pixel ty*tile_size*width + tx*tile_size*h
+where h is the height of its row of tiles.
+
+A writer writes rectangles in any order, as threads finish them, and
+marks each tile once all its pixels are in, so a file cut short by a
+crash shows which tiles still need computing.
+*/
+
+#ifndef ITERFILE_H
+#define ITERFILE_H
+
+#include "render.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ITERFILE_MAGIC "FRACITER"
+#define ITERFILE_VERSION 1
+#define ITERFILE_ALIGN 4096
+
+#define ITERFILE_DIST 1		/* the file has a distance for each pixel */
+
+typedef struct {
+	char magic[8];		/* ITERFILE_MAGIC, not terminated */
+	uint32_t version;
+	uint32_t flags;		/* ITERFILE_ flags */
+	uint32_t width;
+	uint32_t height;
+	uint32_t tile_size;
+	int32_t maxiter;
+	int32_t fractal;	/* FRACTAL_ family */
+	int32_t power;
+	int32_t precision;	/* the PREC_ the iterations were computed with */
+	uint32_t reserved;
+	double xmin;
+	double xmax;
+	double ymin;
+	double ymax;
+	double kx;
+	double ky;
+	uint64_t tiles_offset;	/* where each section starts in the file */
+	uint64_t iters_offset;
+	uint64_t dist_offset;	/* 0 without ITERFILE_DIST */
+	uint64_t size;		/* of the whole file */
+} iterfile_header;
+
+typedef struct {
+	iterfile_header h;
+	viewport v;
+	int fd;
+	int writing;
+	int tiles_x;
+	int tiles_y;
+
+	/* Reading: the file mapped, and its sections within it. */
+	unsigned char *map;
+	const unsigned char *tiles;
+	const int32_t *iters;
+	const float *dist;
+
+	/* Writing: pixels written to each tile so far. */
+	int *filled;
+} iterfile;
+
+/*
+Create path for a render of v computed with precision, cut into
+tiles of tile_size, with a distance section if with_dist.  The file
+is created at its full size, every tile unwritten.
+*/
+void iterfile_create( iterfile *f, const char *path, const viewport *v, int precision, int tile_size, int with_dist );
+
+/*
+Write the w x h rectangle at x,y from iters, and from dist if the file
+has distances.  Both are row major with stride values from one row to
+the next, starting at the rectangle's top left.  Rectangles may come
+in any order and from several threads at once, as long as no two
+overlap.
+*/
+void iterfile_write( iterfile *f, int x, int y, int w, int h, const int *iters, const float *dist, size_t stride );
+
+/*
+A render_draw_t that writes each finished rectangle of a render_image
+call to the iterfile_sink given as its arg.
+*/
+typedef struct {
+	iterfile *f;
+	const int *iters;	/* the buffers render_image is filling */
+	const float *dist;
+} iterfile_sink;
+
+void iterfile_draw( const viewport *v, const unsigned int *colors, int x, int y, int w, int h, void *arg );
+
+/* Map path for reading, checking its header and that every section is inside it. */
+void iterfile_open( iterfile *f, const char *path );
+
+/* Finish writing, or unmap, and close. */
+void iterfile_close( iterfile *f );
+
+/* The index of pixel x, y in the iterations and distances of f. */
+size_t iterfile_index( const iterfile *f, int x, int y );
+
+/* Return whether tile tx, ty of a file opened for reading is complete. */
+int iterfile_tile_done( const iterfile *f, int tx, int ty );
+
+/*
+Copy the w x h rectangle at x,y of a file opened for reading into
+iters and, if not NULL and the file has them, dist, row major with
+stride values per row.
+*/
+void iterfile_read( const iterfile *f, int x, int y, int w, int h, int *iters, float *dist, size_t stride );
+
+#endif
@@ -0,0 +1,282 @@
+/*
+kernel.c - Iteration kernels for every fractal family.
+See kernel.h for the interface.
+
+Every kernel is the same loop, written once as a macro and expanded
+for each family, power and floating point type.  A family is given
+by a few macros named after it:
+
+family_Z0(p, k)	the first z, from the pixel p or the Julia parameter k
+family_C(p, k)	the constant added at each step
+family_FOLD	what is done to z before it is raised to the power
+family_FOLD_D	the same for the derivative dz/dc
+family_D0	the first dz
+family_DC	what is added to dz at each step
+family_CONFORMAL	whether the distance estimate bounds the true distance
+
+Raising to the power is a loop with a constant trip count, which the
+compiler unrolls.  The complex arithmetic is written out on the real
+and imaginary parts, and |z| < 4 is tested as |z|^2 < 16, so that
+every type takes exactly the same steps.
+*/
+
+#include "kernel.h"
+
+#include <float.h>
+#include <math.h>
+
+// z^n + c from z = 0: the Mandelbrot set, and the Multibrots for n > 2.
+#define mandelbrot_Z0(p, k) 0
+#define mandelbrot_C(p, k) (p)
+#define mandelbrot_FOLD(zx, zy, abs)
+#define mandelbrot_FOLD_D(zx, zy, dx, dy)
+#define mandelbrot_D0 0
+#define mandelbrot_DC 1
+#define mandelbrot_CONFORMAL 1
+
+// z^n + k from z = c, with dz/dc starting at 1.
+#define julia_Z0(p, k) (p)
+#define julia_C(p, k) (k)
+#define julia_FOLD(zx, zy, abs)
+#define julia_FOLD_D(zx, zy, dx, dy)
+#define julia_D0 1
+#define julia_DC 0
+#define julia_CONFORMAL 1
+
+// (|Re z| + i|Im z|)^n + c
+#define ship_Z0(p, k) 0
+#define ship_C(p, k) (p)
+#define ship_FOLD(zx, zy, abs) zx = abs(zx); zy = abs(zy);
+#define ship_FOLD_D(zx, zy, dx, dy) if (zx < 0) dx = -dx; if (zy < 0) dy = -dy;
+#define ship_D0 0
+#define ship_DC 1
+#define ship_CONFORMAL 0
+
+// conj(z)^n + c
+#define tricorn_Z0(p, k) 0
+#define tricorn_C(p, k) (p)
+#define tricorn_FOLD(zx, zy, abs) zy = -zy;
+#define tricorn_FOLD_D(zx, zy, dx, dy) dy = -dy;
+#define tricorn_D0 0
+#define tricorn_DC 1
+#define tricorn_CONFORMAL 0
+
+/* Set rx, ry to (zx + i*zy)^n. */
+
+#define POWER(type, n, zx, zy, rx, ry) \
+	type rx = zx, ry = zy; \
+	for (int p_ = 1; p_ < n; p_++) { \
+		type t_ = rx*zx - ry*zy; \
+		ry = rx*zy + ry*zx; \
+		rx = t_; \
+	}
+
+#define POINT_KERNEL(family, n, type, suffix, abs) \
+static int family##_point##n##suffix( type px, type py, type kx, type ky, int max ) \
+{ \
+	type zx = family##_Z0(px, kx), zy = family##_Z0(py, ky); \
+	type cx = family##_C(px, kx), cy = family##_C(py, ky); \
+	int iter = 0; \
+\
+	while( zx*zx + zy*zy < 16 && iter < max ) { \
+		family##_FOLD(zx, zy, abs) \
+		POWER(type, n, zx, zy, rx, ry) \
+		zx = rx + cx; \
+		zy = ry + cy; \
+		iter++; \
+	} \
+\
+	return iter; \
+}
+
+/*
+The distance kernels also carry the derivative dz/dc, which follows
+dz = n*z^(n-1)*dz + DC.  When z escapes, |z|*log|z|/|dz| estimates
+the distance from the point to the set.
+*/
+
+#define DISTANCE_KERNEL(family, n, type, suffix, abs, sqrt, log) \
+static int family##_distance##n##suffix( type px, type py, type kx, type ky, int max, double *distance ) \
+{ \
+	type zx = family##_Z0(px, kx), zy = family##_Z0(py, ky); \
+	type cx = family##_C(px, kx), cy = family##_C(py, ky); \
+	type dx = family##_D0, dy = 0; \
+	int iter = 0; \
+\
+	while( zx*zx + zy*zy < 16 && iter < max ) { \
+		family##_FOLD_D(zx, zy, dx, dy) \
+		family##_FOLD(zx, zy, abs) \
+		POWER(type, n - 1, zx, zy, qx, qy) \
+		type t = n*(qx*dx - qy*dy) + family##_DC; \
+		dy = n*(qx*dy + qy*dx); \
+		dx = t; \
+		POWER(type, n, zx, zy, rx, ry) \
+		zx = rx + cx; \
+		zy = ry + cy; \
+		iter++; \
+	} \
+\
+	if (iter == max) { \
+		*distance = 0; \
+	} else { \
+		type z = sqrt(zx*zx + zy*zy); \
+		*distance = z * log(z) / sqrt(dx*dx + dy*dy); \
+	} \
+\
+	return iter; \
+}
+
+#define FLOAT_ERR_LIMIT 1e-3f
+
+static float_lanes abs_lanes( float_lanes a )
+{
+	return (float_lanes)((int_lanes)a & 0x7fffffff);
+}
+
+/*
+Alongside z, each lane carries err2, the square of a first order
+bound on how far its z has drifted from the z a double would compute:
+the error of the last step grows by |n*z^(n-1)|, which folding z
+cannot increase, and each step adds its own rounding, at most about
+n*|z|^n + 3|c| ulps.  Working with the square avoids a square root,
+at the cost of 1/256 of slack per step.  When the error could carry
+|z|^2 across 16 (|z| < 6 near there, so a shift of 12*err covers it),
+or grows too large for the bound to hold, float cannot decide the
+point and its result is -1, so that the caller computes it in double
+instead.  Every other result is exactly what the double kernel returns.
+*/
+
+#define LANES_KERNEL(family, n) \
+static void family##_lanes##n( const float_lanes *px, const float_lanes *py, float kx, float ky, int max, int *result ) \
+{ \
+	const float u = FLT_EPSILON; \
+	const float limit2 = FLOAT_ERR_LIMIT * FLOAT_ERR_LIMIT; \
+	float_lanes zero = { 0 }; \
+	float_lanes zx = zero + family##_Z0(*px, kx), zy = zero + family##_Z0(*py, ky); \
+	float_lanes cx = zero + family##_C(*px, kx), cy = zero + family##_C(*py, ky); \
+	float_lanes c = abs_lanes(cx) + abs_lanes(cy); \
+	float_lanes p = abs_lanes(*px) + abs_lanes(*py); \
+	float_lanes err2 = u * u * p * p;	/* rounding the pixel to float */ \
+	int_lanes iter = { 0 }, unsure = { 0 }, live = { 0 }; \
+\
+	live = ~live; \
+\
+	for (int i = 0; i < max; i++) { \
+		float_lanes r2 = zx*zx + zy*zy; \
+		float_lanes slack = abs_lanes(r2 - 16) - 2*u*r2 - err2; \
+		int_lanes near = (slack <= 0) | (slack*slack <= 144*err2) | (err2 > limit2); \
+		int any = 0; \
+\
+		unsure |= live & near; \
+		live &= ~(near | (r2 >= 16)); \
+		for (int l = 0; l < FLOAT_LANES; l++) \
+			any |= live[l]; \
+		if (!any) \
+			break; \
+\
+		/* |z|^n, and |n*z^(n-1)|^2, from r2 = |z|^2 */ \
+		float_lanes zn = zero + (n % 2 ? 0.5f : 1.0f); \
+		if (n % 2) \
+			zn *= 1 + r2; \
+		for (int p_ = 0; p_ < n / 2; p_++) \
+			zn *= r2; \
+		float_lanes growth = zero + (float)(n * n); \
+		for (int p_ = 1; p_ < n; p_++) \
+			growth *= r2; \
+\
+		float_lanes d = u*(n*zn + 3*c); \
+		family##_FOLD(zx, zy, abs_lanes) \
+		POWER(float_lanes, n, zx, zy, rx, ry) \
+		zx = rx + cx; \
+		zy = ry + cy; \
+		iter -= live; \
+		err2 = (1 + 1.0f/256)*growth*err2 + 257*d*d; \
+	} \
+\
+	for (int l = 0; l < FLOAT_LANES; l++) \
+		result[l] = unsure[l] ? -1 : iter[l]; \
+}
+
+#define KERNELS(family, n) \
+	POINT_KERNEL(family, n, double, , fabs) \
+	POINT_KERNEL(family, n, long double, _long, fabsl) \
+	DISTANCE_KERNEL(family, n, double, , fabs, sqrt, log) \
+	DISTANCE_KERNEL(family, n, long double, _long, fabsl, sqrtl, logl) \
+	LANES_KERNEL(family, n)
+
+#define FAMILY_KERNELS(family) \
+	KERNELS(family, 2) \
+	KERNELS(family, 3) \
+	KERNELS(family, 4) \
+	KERNELS(family, 5) \
+	KERNELS(family, 6) \
+	KERNELS(family, 7) \
+	KERNELS(family, 8)
+
+FAMILY_KERNELS(mandelbrot)
+FAMILY_KERNELS(julia)
+FAMILY_KERNELS(ship)
+FAMILY_KERNELS(tricorn)
+
+#define KERNEL_SET(family, n) \
+	{ family##_point##n, family##_point##n##_long, family##_lanes##n, \
+	  family##_distance##n, family##_distance##n##_long, family##_CONFORMAL }
+
+#define FAMILY_SETS(family) { \
+	KERNEL_SET(family, 2), \
+	KERNEL_SET(family, 3), \
+	KERNEL_SET(family, 4), \
+	KERNEL_SET(family, 5), \
+	KERNEL_SET(family, 6), \
+	KERNEL_SET(family, 7), \
+	KERNEL_SET(family, 8) }
+
+static const kernel_set kernels[FRACTAL_COUNT][MAX_POWER - 1] = {
+	[FRACTAL_MANDELBROT] = FAMILY_SETS(mandelbrot),
+	[FRACTAL_JULIA] = FAMILY_SETS(julia),
+	[FRACTAL_SHIP] = FAMILY_SETS(ship),
+	[FRACTAL_TRICORN] = FAMILY_SETS(tricorn),
+};
+
+const kernel_set *kernel_get( int fractal, int power )
+{
+	if (fractal < 0 || fractal >= FRACTAL_COUNT)
+		fractal = FRACTAL_MANDELBROT;
+	if (power < 2)
+		power = 2;
+	if (power > MAX_POWER)
+		power = MAX_POWER;
+	return &kernels[fractal][power - 2];
+}
+
+/*
+Compute the number of iterations at point x, y
+in the complex space, up to a maximum of maxiter.
+Return the number of iterations at that point.
+
+This example computes the Mandelbrot fractal:
+z = z^2 + alpha
+
+Where z is initially zero, and alpha is the location x + iy
+in the complex plane.
+*/
+
+int compute_point( double x, double y, int max )
+{
+	return mandelbrot_point2(x, y, 0, 0, max);
+}
+
+int compute_point_long( long double x, long double y, int max )
+{
+	return mandelbrot_point2_long(x, y, 0, 0, max);
+}
+
+int compute_point_distance( double x, double y, int max, double *distance )
+{
+	return mandelbrot_distance2(x, y, 0, 0, max, distance);
+}
+
+int compute_point_distance_long( long double x, long double y, int max, double *distance )
+{
+	return mandelbrot_distance2_long(x, y, 0, 0, max, distance);
+}
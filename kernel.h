@@ -0,0 +1,54 @@
+/*
+kernel.h - Iteration kernels for every fractal family.
+
+Each family and power has its own set of kernels, generated at
+compile time, so the inner loops never branch on the formula.
+The render engines pick a set once per frame with kernel_get.
+*/
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "render.h"
+
+/*
+The float kernels iterate FLOAT_LANES points at once in vector
+registers, which is what makes float worth having: twice the lanes
+of double in the same register.  Build with -mavx2 or -mavx512f to
+get 8 or 16 lanes.
+*/
+
+#if defined(__AVX512F__)
+#define FLOAT_LANES 16
+#elif defined(__AVX__)
+#define FLOAT_LANES 8
+#else
+#define FLOAT_LANES 4
+#endif
+
+typedef float float_lanes __attribute__((vector_size(FLOAT_LANES * sizeof(float))));
+typedef int int_lanes __attribute__((vector_size(FLOAT_LANES * sizeof(int))));
+
+/*
+The kernels of one family and power.  Points are pixel positions
+x, y in the plane, and kx, ky is the Julia parameter, which the
+other families ignore.
+*/
+typedef struct {
+	int (*point)( double x, double y, double kx, double ky, int max );
+	int (*point_long)( long double x, long double y, long double kx, long double ky, int max );
+
+	/* Set result to the iterations of each lane, or -1 where float cannot match point. */
+	void (*lanes)( const float_lanes *x, const float_lanes *y, float kx, float ky, int max, int *result );
+
+	/* Also set distance to the estimated distance to the set, or 0 if the point never escaped. */
+	int (*distance)( double x, double y, double kx, double ky, int max, double *distance );
+	int (*distance_long)( long double x, long double y, long double kx, long double ky, int max, double *distance );
+
+	int conformal;	/* the estimate bounds the true distance */
+} kernel_set;
+
+/* Return the kernels for the given FRACTAL_ family and power. */
+const kernel_set *kernel_get( int fractal, int power );
+
+#endif
@@ -0,0 +1,230 @@
+/*
+preview.c - A live Julia set preview over the corner of the window.
+See preview.h for the interface.
+*/
+
+#define _GNU_SOURCE
+
+#include "preview.h"
+#include "gfx.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+/* Half the height of the preview in the plane, which holds the Julia sets of every power. */
+#define PREVIEW_RADIUS 1.5
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *alloc_pixels( void *ptr, size_t pixels )
+{
+	ptr = realloc(ptr, pixels * sizeof(unsigned int));
+	if (!ptr) {
+		perror("realloc");
+		exit(1);
+	}
+	return ptr;
+}
+
+/*
+Compute each request coarse to fine, publishing every pass as it
+finishes.  A newer request abandons the rest of the passes, so
+while the pointer is moving only the cheap first pass is computed.
+*/
+
+static void *preview_thread( void *arg )
+{
+	julia_preview *p = (julia_preview *)arg;
+
+	pthread_mutex_lock(&p->mutex);
+	while (1) {
+		while (!p->pending && !p->closing)
+			pthread_cond_wait(&p->wake, &p->mutex);
+		if (p->closing)
+			break;
+
+		viewport v = p->request;
+		render_opts o;
+		render_opts_init(&o, SCHED_TILE, p->num_threads);
+		o.pool = p->pool;
+		o.first_worker = p->first_worker;
+		double requested = p->requested;
+		p->pending = 0;
+		pthread_mutex_unlock(&p->mutex);
+
+		size_t size = (size_t)v.width * v.height;
+		if (size > p->size) {
+			p->colors = alloc_pixels(p->colors, size);
+			p->iters = alloc_pixels(p->iters, size);
+			p->size = size;
+		}
+
+		for (int pass = PREVIEW_PASSES - 1; pass >= 0; pass--) {
+			viewport pv = v;
+			pv.width = v.width >> pass > 0 ? v.width >> pass : 1;
+			pv.height = v.height >> pass > 0 ? v.height >> pass : 1;
+
+			double start = now();
+			render_image(&pv, &o, p->iters, NULL, p->colors, NULL, NULL);
+			double done = now();
+
+			pthread_mutex_lock(&p->mutex);
+			if (p->pending || p->closing)
+				break;
+
+			size_t pixels = (size_t)pv.width * pv.height;
+			if (pixels > (size_t)p->ready_width * p->ready_height)
+				p->ready = alloc_pixels(p->ready, pixels);
+			memcpy(p->ready, p->colors, pixels * sizeof(unsigned int));
+			p->ready_width = pv.width;
+			p->ready_height = pv.height;
+			pthread_mutex_unlock(&p->mutex);
+
+			uint64_t one = 1;
+			if (write(p->fd, &one, sizeof(one)) != sizeof(one)) {
+				perror("write");
+				exit(1);
+			}
+
+			if (p->verbose)
+				fprintf(stderr, "preview: %dx%d %d threads: %.2f ms after the request, %.2f ms to compute\n",
+					pv.width, pv.height, o.num_threads, (done - requested) * 1e3, (done - start) * 1e3);
+
+			pthread_mutex_lock(&p->mutex);
+		}
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	return NULL;
+}
+
+void preview_start( julia_preview *p, render_pool *pool )
+{
+	p->pool = pool;
+	p->closing = 0;
+	p->pending = 0;
+
+	p->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (p->fd < 0) {
+		perror("eventfd");
+		exit(1);
+	}
+
+	if (pthread_mutex_init(&p->mutex, NULL) || pthread_cond_init(&p->wake, NULL)) {
+		perror("pthread_mutex_init");
+		exit(1);
+	}
+
+	if (pthread_create(&p->thread, NULL, preview_thread, p)) {
+		perror("pthread_create");
+		exit(1);
+	}
+}
+
+void preview_stop( julia_preview *p )
+{
+	pthread_mutex_lock(&p->mutex);
+	p->closing = 1;
+	pthread_cond_signal(&p->wake);
+	pthread_mutex_unlock(&p->mutex);
+
+	if (pthread_join(p->thread, NULL)) {
+		perror("pthread_join");
+		exit(1);
+	}
+
+	pthread_cond_destroy(&p->wake);
+	pthread_mutex_destroy(&p->mutex);
+	close(p->fd);
+	free(p->ready);
+	free(p->colors);
+	free(p->iters);
+	p->ready = NULL;
+	p->colors = NULL;
+	p->iters = NULL;
+	p->size = 0;
+	p->ready_width = 0;
+	p->ready_height = 0;
+}
+
+int preview_reserve( int num_threads )
+{
+	return num_threads / PREVIEW_SHARE;
+}
+
+void preview_request( julia_preview *p, double kx, double ky, int power, int maxiter, int num_threads )
+{
+	int width = gfx_xsize() / PREVIEW_SIZE;
+	int height = gfx_ysize() / PREVIEW_SIZE;
+	int reserve = preview_reserve(num_threads);
+
+	if (width < 1 || height < 1)
+		return;
+
+	double xradius = PREVIEW_RADIUS * width / height;
+	viewport v = { -xradius, xradius, -PREVIEW_RADIUS, PREVIEW_RADIUS, width, height, maxiter,
+		FRACTAL_JULIA, power, kx, ky };
+
+	pthread_mutex_lock(&p->mutex);
+	p->request = v;
+	p->first_worker = num_threads - reserve;
+	p->num_threads = reserve > 0 ? reserve : 1;
+	p->requested = now();
+	p->pending = 1;
+	pthread_cond_signal(&p->wake);
+	pthread_mutex_unlock(&p->mutex);
+}
+
+/*
+The last pass is scaled to the corner with nearest neighbour
+sampling, so the coarse passes show as blocks of pixels.
+*/
+
+void preview_show( julia_preview *p, render_buffer *b, int use_fb )
+{
+	uint64_t count;
+
+	// Clear the eventfd; however many passes it counts, only the last is shown.
+	if (read(p->fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+		perror("read");
+		exit(1);
+	}
+
+	int width = b->width / PREVIEW_SIZE;
+	int height = b->height / PREVIEW_SIZE;
+	int x0 = b->width - width;
+	if (!b->iters || width < 1 || height < 1)
+		return;
+
+	render_draw_t draw;
+	unsigned int *colors = render_window_colors(b, use_fb, &draw);
+
+	pthread_mutex_lock(&p->mutex);
+	if (!p->ready) {
+		pthread_mutex_unlock(&p->mutex);
+		return;
+	}
+	for (int j = 0; j < height; j++) {
+		const unsigned int *src = p->ready + (size_t)(j * p->ready_height / height) * p->ready_width;
+		unsigned int *dst = colors + (size_t)j * b->width + x0;
+		for (int i = 0; i < width; i++)
+			dst[i] = src[i * p->ready_width / width];
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	viewport v = { 0 };
+	v.width = b->width;
+	v.height = b->height;
+	draw(&v, colors, x0, 0, width, height, NULL);
+}
@@ -0,0 +1,69 @@
+/*
+preview.h - A live Julia set preview over the corner of the window.
+
+While the preview is on, the Julia set for the point under the
+pointer is drawn in the top right corner of the window.  It is
+computed on a thread of its own, on pool workers the main view
+leaves free, first coarsely and then at finer resolutions, so
+neither the main view nor the event loop ever waits for it.
+*/
+
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "render.h"
+
+#include <pthread.h>
+
+#define PREVIEW_SIZE 3		/* the preview is 1/PREVIEW_SIZE of the window on each side */
+#define PREVIEW_PASSES 3	/* each pass doubles the resolution, ending at full size */
+#define PREVIEW_SHARE 4		/* the preview reserves 1/PREVIEW_SHARE of the workers */
+
+typedef struct {
+	int fd;		/* an eventfd, readable when a pass is ready to show */
+	int verbose;	/* print the latency of each pass to stderr */
+
+	render_pool *pool;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t wake;	/* a request came in, or the preview is closing */
+	int closing;
+
+	/* The latest request, under the mutex. */
+	int pending;
+	viewport request;
+	int first_worker;
+	int num_threads;
+	double requested;
+
+	/* The last finished pass, under the mutex. */
+	unsigned int *ready;
+	int ready_width;
+	int ready_height;
+
+	/* Owned by the preview thread. */
+	unsigned int *colors;
+	int *iters;
+	size_t size;
+} julia_preview;
+
+/* Start the preview thread, which runs its passes on workers of pool. */
+void preview_start( julia_preview *p, render_pool *pool );
+void preview_stop( julia_preview *p );
+
+/* Return how many of num_threads workers the main view gives up to the preview. */
+int preview_reserve( int num_threads );
+
+/*
+Ask for the Julia set of power n at kx, ky, sized for the current
+window.  The main view runs on num_threads workers, less
+preview_reserve of them, and the preview takes the rest, or one
+more worker if that leaves none.  A request made while a previous
+one is computing replaces it at its next pass.
+*/
+void preview_request( julia_preview *p, double kx, double ky, int power, int maxiter, int num_threads );
+
+/* Draw the last finished pass over the image in b, which must be on screen. */
+void preview_show( julia_preview *p, render_buffer *b, int use_fb );
+
+#endif
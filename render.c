@@ -0,0 +1,1605 @@
+/*
+render.c - Shared Mandelbrot render engines.
+See render.h for the interface.
+*/
+
+#define _GNU_SOURCE
+
+#include "render.h"
+#include "kernel.h"
+#include "counters.h"
+#include "trace.h"
+#include "gfx.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#define MAX_NODES 256
+#define SPAN_CHUNK 64	// pixels handed to the kernel at once
+#define EQUALIZE_BINS 65536	// most histogram bins per thread, see equalize
+
+/* State shared by every thread working on one image. */
+typedef struct {
+	const viewport *v;
+	const render_opts *o;
+	int pass;
+	int precision;
+	const kernel_set *kernel;
+	int fill;	// distance_tile may fill exterior discs
+	int *iters;
+	float *dist;	// only in distance mode
+	unsigned int *colors;
+	render_draw_t draw;
+	void *arg;
+	frame_stats *stats;
+	pthread_mutex_t mutex;	// serializes draw calls and the task counter
+	int tiles_x;
+	int tiles_y;
+	int tile_size;
+	int next_task;
+
+	// For o->equalize: see equalize.
+	int num_threads;
+	pthread_barrier_t barrier;
+	int bins;		// escape counts below exact_bins have a bin each, the rest share
+	int exact_bins;		// bins of bin_step counts, and the last bin holds the interior
+	int bin_step;
+	unsigned int *partial;	// a histogram for each thread
+	unsigned int *hist;
+	long *slice_sums;	// escaped pixels in each thread's slice of the bins
+	float *cdf;		// the position of each count in the gradient, once known
+} render_job;
+
+// What a job does with each span of pixels.
+#define PASS_TOUCH 0		// only fault in the pages, for render_buffer_get
+#define PASS_COMPUTE 1		// one sample per pixel
+#define PASS_ANTIALIAS 2	// supersample the pixels on edges
+#define PASS_EQUALIZE 3		// color through the histogram, see equalize
+
+typedef struct {
+	int thread_id;
+	render_job *job;
+	thread_stats *stats;	// NULL unless the caller asked for stats
+} thread_args;
+
+static const char *schedule_names[SCHED_COUNT] = { "serial", "band", "cyclic", "tile" };
+static const char *precision_names[PREC_COUNT] = { "auto", "float", "double", "long" };
+static const char *fractal_names[FRACTAL_COUNT] = { "mandelbrot", "julia", "ship", "tricorn" };
+static const char *pass_names[] = { "touch", "compute", "antialias", "equalize" };
+
+// The cpus we may run on, grouped by NUMA node.
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+static int cpu_order[CPU_SETSIZE];
+static int num_cpus;
+static cpu_set_t allowed_cpus;
+
+/* One thread's share of a render_pool_run call. */
+typedef struct {
+	render_pool_fn fn;
+	void *arg;
+	int thread;
+	int pin;
+	int *running;	// the caller's count of tasks not yet done
+} pool_task;
+
+/*
+A worker of a render_pool.  It sleeps on wake until it is handed
+a task, runs it, and goes back to sleep.  Everything here is under
+the pool mutex.
+*/
+typedef struct {
+	render_pool *pool;
+	int index;
+	int pinned;		// running on cpu_order[index] alone
+	pool_task *task;	// NULL while idle
+	pthread_cond_t wake;
+	pthread_t thread;
+} pool_worker;
+
+struct render_pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t done;	// a worker finished its task
+	pool_worker **workers;
+	int num_workers;
+	int closing;
+};
+
+/*
+Return how many units in the last place of a type with the given
+epsilon one pixel spans, at the largest coordinate in v.  z itself
+reaches magnitude 4 before escaping, so the coordinates are never
+taken to be smaller than that.
+*/
+
+static long double ulps_per_pixel( const viewport *v, long double epsilon )
+{
+	double dx = (v->xmax - v->xmin) / v->width;
+	double dy = (v->ymax - v->ymin) / v->height;
+	double spacing = fmin(fabs(dx), fabs(dy));
+	double m = fmax(fmax(fabs(v->xmin), fabs(v->xmax)), fmax(fabs(v->ymin), fabs(v->ymax)));
+
+	if (m < 4)
+		m = 4;
+
+	return spacing / (m * epsilon);
+}
+
+/*
+Float results are checked point by point, so float only has to be
+fast: it is used while pixels are wide enough that few points fall
+back to double.  Double is not checked, so it has to be exact enough
+on its own: near the boundary of the set rounding error can grow by
+about one ulp per iteration, and maxiter such steps must still land
+well inside the pixel.  Past that, long double takes over.
+*/
+
+int render_precision( const viewport *v, int precision )
+{
+	if (precision != PREC_AUTO)
+		return precision;
+	if (ulps_per_pixel(v, FLT_EPSILON) > PREC_FLOAT_ULPS)
+		return PREC_FLOAT;
+	if (ulps_per_pixel(v, DBL_EPSILON) > (long double)v->maxiter * PREC_MARGIN)
+		return PREC_DOUBLE;
+	return PREC_LONG;
+}
+
+/*
+Pixels just outside the set escape later the more closely they are
+looked at, so a boundary that still has many pixels escaping in the
+top half of maxiter is cut off, and inside pixels near it would escape
+with more.  Halving when nothing passes a quarter keeps every escape
+under the new half, so the two rules never undo each other.
+
+A frame where nothing escapes says nothing: it may lie inside the set,
+or be too deep for maxiter to reach any escape.  It keeps its maxiter,
+and the floor grows with the magnification so a jump deep into the
+boundary still starts where some pixels escape.
+*/
+
+int render_auto_maxiter( const frame_stats *s )
+{
+	int maxiter = s->v.maxiter;
+	double width = s->v.xmax - s->v.xmin;
+	int floor = AUTO_MIN_ITER;
+
+	if (width > 0 && width < AUTO_WIDTH)
+		floor = AUTO_MIN_ITER * (1 + log2(AUTO_WIDTH / width));
+
+	if (s->late * AUTO_LATE > s->escaped && maxiter <= AUTO_MAX_ITER / 2)
+		maxiter *= 2;
+	else if (s->escaped && s->deepest < maxiter / 4)
+		maxiter /= 2;
+
+	if (maxiter < floor)
+		maxiter = floor;
+	if (maxiter > AUTO_MAX_ITER)
+		maxiter = AUTO_MAX_ITER;
+	return maxiter;
+}
+
+/*
+Map a distance to the set, in pixels, to a gray level that
+fades to white over DE_FAR pixels, so the boundary is drawn as a
+crisp line one pixel wide and the set itself is black.
+*/
+
+void color_distance( double distance, int *r, int *g, int *b )
+{
+	double t = distance / DE_FAR;
+
+	*r = *g = *b = t >= 1 ? 255 : (int)(sqrt(t) * 255);
+}
+
+void color_gradient( double t, int *r, int *g, int *b )
+{
+	*r = (int)(9*(1-t)*t*t*t*255);
+	*g = (int)(15*(1-t)*(1-t)*t*t*255);
+	*b = (int)(8.5*(1-t)*(1-t)*(1-t)*t*255);
+}
+
+/*
+Map the iteration count to a color gradient.
+Points that never escaped are drawn black.
+*/
+
+void color_point( int iter, int maxiter, int *r, int *g, int *b )
+{
+	if (iter == maxiter)
+		*r = *g = *b = 0;
+	else
+		color_gradient((double)iter / (double)maxiter, r, g, b);
+}
+
+void render_opts_init( render_opts *o, int schedule, int num_threads )
+{
+	o->schedule = schedule;
+	o->num_threads = num_threads;
+	o->block_rows = BLOCK_ROWS;
+	o->tile_size = TASK_SIZE;
+	o->pin = 0;
+	o->precision = PREC_AUTO;
+	o->aa_samples = 0;
+	o->aa_threshold = AA_THRESHOLD;
+	o->distance = 0;
+	o->fill = 1;
+	o->equalize = 0;
+	o->counters = 0;
+	o->stats = NULL;
+	o->trace = NULL;
+	o->pool = NULL;
+	o->first_worker = 0;
+}
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+Add the cpus listed in a sysfs cpulist such as "0-15,32-47"
+to cpu_order, skipping any we are not allowed to run on.
+*/
+
+static void add_cpulist( const char *list, cpu_set_t *allowed, cpu_set_t *added )
+{
+	const char *p = list;
+
+	while (*p) {
+		char *end;
+		int first = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		int last = first;
+		if (*end == '-')
+			last = strtol(end + 1, &end, 10);
+
+		for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, allowed) && !CPU_ISSET(cpu, added)) {
+				CPU_SET(cpu, added);
+				cpu_order[num_cpus++] = cpu;
+			}
+		}
+
+		p = *end == ',' ? end + 1 : end;
+		if (*end != ',')
+			break;
+	}
+}
+
+/*
+Order the cpus node by node, so that consecutive threads,
+and therefore neighbouring bands of rows, share a node.
+*/
+
+static void read_topology()
+{
+	cpu_set_t allowed, added;
+	char path[64], list[4096];
+
+	CPU_ZERO(&added);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+		CPU_ZERO(&allowed);
+		for (int cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN) && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, &allowed);
+	}
+	allowed_cpus = allowed;
+
+	for (int node = 0; node < MAX_NODES; node++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		FILE *file = fopen(path, "r");
+		if (!file)
+			continue;
+		if (fgets(list, sizeof(list), file))
+			add_cpulist(list, &allowed, &added);
+		fclose(file);
+	}
+
+	// Without sysfs, or for cpus on no node, fall back to numeric order.
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &added))
+			cpu_order[num_cpus++] = cpu;
+	}
+
+	if (num_cpus == 0)
+		cpu_order[num_cpus++] = 0;
+}
+
+int render_default_threads()
+{
+	pthread_once(&topology_once, read_topology);
+	return num_cpus < MAX_THREADS ? num_cpus : MAX_THREADS;
+}
+
+const char *schedule_name( int schedule )
+{
+	if (schedule < 0 || schedule >= SCHED_COUNT)
+		return "unknown";
+	return schedule_names[schedule];
+}
+
+int schedule_parse( const char *name )
+{
+	for (int i = 0; i < SCHED_COUNT; i++) {
+		if (!strcmp(name, schedule_names[i]))
+			return i;
+	}
+	return -1;
+}
+
+const char *fractal_name( int fractal )
+{
+	if (fractal < 0 || fractal >= FRACTAL_COUNT)
+		return "unknown";
+	return fractal_names[fractal];
+}
+
+int fractal_parse( const char *name )
+{
+	for (int i = 0; i < FRACTAL_COUNT; i++) {
+		if (!strcmp(name, fractal_names[i]))
+			return i;
+	}
+	return -1;
+}
+
+const char *precision_name( int precision )
+{
+	if (precision < 0 || precision >= PREC_COUNT)
+		return "unknown";
+	return precision_names[precision];
+}
+
+int precision_parse( const char *name )
+{
+	for (int i = 0; i < PREC_COUNT; i++) {
+		if (!strcmp(name, precision_names[i]))
+			return i;
+	}
+	return -1;
+}
+
+static void lock( render_job *job, thread_stats *ts )
+{
+	double start = ts ? now() : 0;
+
+	if (pthread_mutex_lock(&job->mutex)) {
+		perror("pthread_mutex_lock");
+		exit(1);
+	}
+
+	if (ts)
+		ts->lock_wait += now() - start;
+}
+
+static void unlock( render_job *job )
+{
+	if (pthread_mutex_unlock(&job->mutex)) {
+		perror("pthread_mutex_unlock");
+		exit(1);
+	}
+}
+
+/* The histogram bin of a count, see equalize. */
+
+static int bin_of( const render_job *job, int iter )
+{
+	if (iter < 0)
+		return 0;
+	if (iter >= job->v->maxiter)
+		return job->bins - 1;
+	if (iter < job->exact_bins)
+		return iter;
+	return job->exact_bins + (iter - job->exact_bins) / job->bin_step;
+}
+
+/* Color one sample by its iterations, or in distance mode by its distance. */
+
+static unsigned int sample_color( render_job *job, int iter, float dist )
+{
+	int r, g, b;
+
+	if (job->dist)
+		color_distance(dist, &r, &g, &b);
+	else if (job->cdf && iter >= 0 && iter < job->v->maxiter)
+		color_gradient(job->cdf[bin_of(job, iter)], &r, &g, &b);
+	else
+		color_point(iter, job->v->maxiter, &r, &g, &b);
+	return r << 16 | g << 8 | b;
+}
+
+static unsigned int pixel_color( render_job *job, size_t k )
+{
+	return sample_color(job, job->iters[k], job->dist ? job->dist[k] : 0);
+}
+
+static double plane_x( const viewport *v, double fi )
+{
+	return v->xmin + fi * (v->xmax - v->xmin) / v->width;
+}
+
+static double plane_y( const viewport *v, double fj )
+{
+	return v->ymin + fj * (v->ymax - v->ymin) / v->height;
+}
+
+/* The size of a pixel in the plane: the larger side, so distances in pixels are never overstated. */
+
+static double pixel_size( const viewport *v )
+{
+	return fmax(fabs(v->xmax - v->xmin) / v->width, fabs(v->ymax - v->ymin) / v->height);
+}
+
+/*
+Compute the iterations at the n pixel coordinates fi[k], fj[k]
+with the job's kernels and precision.  For long double the position in the plane
+is found in that type as well, so deep zooms keep the bits of the
+offset from xmin that a double would round away.  In distance mode
+the distance of each point to the set, in pixels, goes to dist.
+*/
+
+static void sample_points( render_job *job, const double *fi, const double *fj, int n, int *result, float *dist )
+{
+	const viewport *v = job->v;
+	const kernel_set *kernel = job->kernel;
+
+	if (job->dist) {
+		double size = pixel_size(v);
+
+		for (int k = 0; k < n; k++) {
+			double d;
+			if (job->precision == PREC_LONG) {
+				result[k] = kernel->distance_long(v->xmin + fi[k] * ((long double)v->xmax - v->xmin) / v->width,
+					v->ymin + fj[k] * ((long double)v->ymax - v->ymin) / v->height, v->kx, v->ky, v->maxiter, &d);
+			} else {
+				result[k] = kernel->distance(plane_x(v, fi[k]), plane_y(v, fj[k]), v->kx, v->ky, v->maxiter, &d);
+			}
+			dist[k] = d / size;
+		}
+		return;
+	}
+
+	switch (job->precision) {
+		case PREC_FLOAT:
+			for (int k = 0; k < n; k += FLOAT_LANES) {
+				float_lanes x, y;
+				int lanes[FLOAT_LANES];
+
+				// A short last group repeats its last point.
+				for (int l = 0; l < FLOAT_LANES; l++) {
+					int p = k + l < n ? k + l : n - 1;
+					x[l] = plane_x(v, fi[p]);
+					y[l] = plane_y(v, fj[p]);
+				}
+				kernel->lanes(&x, &y, v->kx, v->ky, v->maxiter, lanes);
+
+				for (int l = 0; l < FLOAT_LANES && k + l < n; l++) {
+					int p = k + l;
+					result[p] = lanes[l] >= 0 ? lanes[l] : kernel->point(plane_x(v, fi[p]), plane_y(v, fj[p]), v->kx, v->ky, v->maxiter);
+				}
+			}
+			break;
+		case PREC_LONG:
+			for (int k = 0; k < n; k++) {
+				result[k] = kernel->point_long(v->xmin + fi[k] * ((long double)v->xmax - v->xmin) / v->width,
+					v->ymin + fj[k] * ((long double)v->ymax - v->ymin) / v->height, v->kx, v->ky, v->maxiter);
+			}
+			break;
+		default:
+			for (int k = 0; k < n; k++)
+				result[k] = kernel->point(plane_x(v, fi[k]), plane_y(v, fj[k]), v->kx, v->ky, v->maxiter);
+			break;
+	}
+}
+
+/* Count the pixels of a first pass that escaped, for automatic depth. */
+
+static void count_escapes( thread_stats *ts, const int *iters, int n, int maxiter )
+{
+	int half = maxiter / 2;
+
+	if (!ts)
+		return;
+
+	for (int i = 0; i < n; i++) {
+		if (iters[i] >= maxiter)
+			continue;
+		ts->escaped++;
+		if (iters[i] >= half)
+			ts->late++;
+		if (iters[i] > ts->deepest)
+			ts->deepest = iters[i];
+	}
+}
+
+/*
+Compute the pixels x0..x1-1 of row j.
+*/
+
+static void compute_span( render_job *job, thread_stats *ts, int j, int x0, int x1 )
+{
+	const viewport *v = job->v;
+	int *row = job->iters + (size_t)j * v->width;
+	double start = ts ? now() : 0;
+	long long iters = 0;
+
+	double fi[SPAN_CHUNK], fj[SPAN_CHUNK];
+
+	for (int i = x0; i < x1; i += SPAN_CHUNK) {
+		int n = x1 - i < SPAN_CHUNK ? x1 - i : SPAN_CHUNK;
+		for (int k = 0; k < n; k++) {
+			fi[k] = i + k;
+			fj[k] = j;
+		}
+		sample_points(job, fi, fj, n, row + i, job->dist ? job->dist + (size_t)j * v->width + i : NULL);
+	}
+
+	for (int i = x0; i < x1; i++)
+		iters += row[i];
+	count_escapes(ts, row + x0, x1 - x0, v->maxiter);
+
+	if (job->colors) {
+		unsigned int *colors = job->colors + (size_t)j * v->width;
+		for (int i = x0; i < x1; i++)
+			colors[i] = pixel_color(job, (size_t)j * v->width + i);
+	}
+
+	if (ts) {
+		ts->compute += now() - start;
+		ts->iters += iters;
+		ts->samples += x1 - x0;
+	}
+}
+
+/* A repeatable offset in [0,1) for sample s of pixel i,j. */
+
+static double jitter( unsigned int i, unsigned int j, unsigned int s )
+{
+	unsigned int h = i * 73856093u ^ j * 19349663u ^ s * 83492791u;
+	h ^= h >> 13;
+	h *= 0x5bd1e995u;
+	h ^= h >> 15;
+	return (h & 0xffffff) / 16777216.0;
+}
+
+static int color_difference( unsigned int a, unsigned int b )
+{
+	return abs((int)(a >> 16) - (int)(b >> 16)) + abs((int)((a >> 8) & 0xff) - (int)((b >> 8) & 0xff)) + abs((int)(a & 0xff) - (int)(b & 0xff));
+}
+
+/* A pixel is on an edge if its color is far from one of its four neighbours. */
+
+static int on_edge( render_job *job, int i, int j, unsigned int color )
+{
+	const viewport *v = job->v;
+	int threshold = job->o->aa_threshold;
+	int di[4] = { -1, 1, 0, 0 };
+	int dj[4] = { 0, 0, -1, 1 };
+
+	for (int k = 0; k < 4; k++) {
+		int ni = i + di[k], nj = j + dj[k];
+		if (ni < 0 || nj < 0 || ni >= v->width || nj >= v->height)
+			continue;
+		if (color_difference(color, pixel_color(job, (size_t)nj * v->width + ni)) > threshold)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+Supersample the pixels x0..x1-1 of row j that are on an edge,
+averaging the colors of aa_samples jittered points inside the pixel
+with the first sample, and store the result in the color buffer.
+Reads the whole iteration buffer, so it runs after PASS_COMPUTE.
+*/
+
+static void antialias_span( render_job *job, thread_stats *ts, int j, int x0, int x1 )
+{
+	const viewport *v = job->v;
+	unsigned int *colors = job->colors + (size_t)j * v->width;
+	int samples = job->o->aa_samples < AA_MAX_SAMPLES ? job->o->aa_samples : AA_MAX_SAMPLES;
+	double fi[AA_MAX_SAMPLES], fj[AA_MAX_SAMPLES];
+	int iter[AA_MAX_SAMPLES];
+	float dist[AA_MAX_SAMPLES];
+	double start = ts ? now() : 0;
+	long long iters = 0, extra = 0;
+
+	for (int i = x0; i < x1; i++) {
+		unsigned int color = pixel_color(job, (size_t)j * v->width + i);
+
+		if (on_edge(job, i, j, color)) {
+			int r = color >> 16, g = (color >> 8) & 0xff, b = color & 0xff;
+
+			for (int s = 0; s < samples; s++) {
+				fi[s] = i + jitter(i, j, 2 * s);
+				fj[s] = j + jitter(i, j, 2 * s + 1);
+			}
+			sample_points(job, fi, fj, samples, iter, dist);
+
+			for (int s = 0; s < samples; s++) {
+				unsigned int c = sample_color(job, iter[s], dist[s]);
+
+				r += c >> 16;
+				g += (c >> 8) & 0xff;
+				b += c & 0xff;
+				iters += iter[s];
+			}
+
+			r /= samples + 1;
+			g /= samples + 1;
+			b /= samples + 1;
+			color = r << 16 | g << 8 | b;
+			extra += samples;
+		}
+
+		colors[i] = color;
+	}
+
+	if (ts) {
+		ts->compute += now() - start;
+		ts->iters += iters;
+		ts->samples += extra;
+	}
+}
+
+static void draw_rect( render_job *job, thread_stats *ts, int x, int y, int w, int h )
+{
+	if (!job->draw)
+		return;
+
+	lock(job, ts);
+	double start = ts ? now() : 0;
+	job->draw(job->v, job->colors, x, y, w, h, job->arg);
+	if (ts)
+		ts->draw += now() - start;
+	unlock(job);
+}
+
+/* Do this job's pass over the pixels x0..x1-1 of row j. */
+
+static void do_span( render_job *job, thread_stats *ts, int j, int x0, int x1 )
+{
+	switch (job->pass) {
+		case PASS_TOUCH:
+			memset(job->iters + (size_t)j * job->v->width + x0, 0, (size_t)(x1 - x0) * sizeof(int));
+			break;
+		case PASS_COMPUTE:
+			compute_span(job, ts, j, x0, x1);
+			break;
+		case PASS_ANTIALIAS:
+			antialias_span(job, ts, j, x0, x1);
+			break;
+	}
+}
+
+/*
+With o->counters, note the thread's counters before a tile and add
+what they counted to its stats after.  A counter that cannot be read
+stays at -1 for the frame.
+*/
+
+static void counters_start( render_job *job, thread_stats *ts, long long *start )
+{
+	if (ts && job->o->counters)
+		counters_read(start);
+}
+
+static void counters_stop( render_job *job, thread_stats *ts, const long long *start )
+{
+	long long end[COUNTER_COUNT];
+
+	if (!ts || !job->o->counters)
+		return;
+
+	counters_read(end);
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		if (start[i] < 0 || end[i] < 0)
+			ts->counters[i] = -1;
+		else if (ts->counters[i] >= 0)
+			ts->counters[i] += end[i] - start[i];
+	}
+}
+
+/*
+With o->trace, record the rectangle the thread of ts began on at
+start, with the iterations it has added to ts since it had iters.
+Without a trace this costs a test per tile.
+*/
+
+static double trace_start( render_job *job, thread_stats *ts )
+{
+	return ts && job->o->trace ? now() : 0;
+}
+
+static void trace_stop( render_job *job, thread_stats *ts, double start, long long iters, int x, int y, int w, int h )
+{
+	if (ts && job->o->trace)
+		trace_record(job->o->trace, ts - job->stats->threads, pass_names[job->pass], x, y, w, h, start, now(), ts->iters - iters);
+}
+
+/* Compute and draw the rows start..end-1. */
+
+static void compute_rows( render_job *job, thread_stats *ts, int start, int end )
+{
+	long long counted[COUNTER_COUNT];
+
+	for (int j = start; j < end; j++) {
+		long long iters = ts ? ts->iters : 0;
+		double traced = trace_start(job, ts);
+		counters_start(job, ts, counted);
+		do_span(job, ts, j, 0, job->v->width);
+		counters_stop(job, ts, counted);
+		trace_stop(job, ts, traced, iters, 0, j, job->v->width, 1);
+		draw_rect(job, ts, 0, j, job->v->width, 1);
+		if (ts)
+			ts->tiles++;
+	}
+}
+
+/*
+Band schedule: thread t owns rows [t*height/N, (t+1)*height/N).
+*/
+
+static void compute_band( render_job *job, thread_args *thread )
+{
+	int height = job->v->height;
+	int n = job->o->num_threads;
+
+	int start = thread->thread_id * height / n;
+	int end = (thread->thread_id + 1) * height / n;
+
+	compute_rows(job, thread->stats, start, end);
+}
+
+/*
+Cyclic schedule: the image is cut into blocks of block_rows rows,
+and block b belongs to thread b % N.  Expensive regions of the set
+are spread over every thread instead of landing in a single band.
+*/
+
+static void compute_cyclic( render_job *job, thread_args *thread )
+{
+	int height = job->v->height;
+	int n = job->o->num_threads;
+	int rows = job->o->block_rows > 0 ? job->o->block_rows : 1;
+
+	for (int start = thread->thread_id * rows; start < height; start += n * rows) {
+		int end = start + rows < height ? start + rows : height;
+		compute_rows(job, thread->stats, start, end);
+	}
+}
+
+/*
+Mark every pixel of the tile within radius of i,j that is not
+computed yet as exterior, with bound - r as its distance.
+*/
+
+static void fill_disc( render_job *job, int i, int j, double radius, double bound, int x0, int y0, int w, int h )
+{
+	const viewport *v = job->v;
+	int r = (int)radius;
+	int jmin = j - r > y0 ? j - r : y0, jmax = j + r < y0 + h - 1 ? j + r : y0 + h - 1;
+	int imin = i - r > x0 ? i - r : x0, imax = i + r < x0 + w - 1 ? i + r : x0 + w - 1;
+
+	for (int fj = jmin; fj <= jmax; fj++) {
+		for (int fi = imin; fi <= imax; fi++) {
+			size_t k = (size_t)fj * v->width + fi;
+			double d2 = (double)(fi - i) * (fi - i) + (double)(fj - j) * (fj - j);
+
+			if (job->iters[k] < 0 && d2 <= radius * radius) {
+				job->iters[k] = 0;
+				job->dist[k] = bound - sqrt(d2);
+			}
+		}
+	}
+}
+
+/*
+Compute a tile in distance mode.  The estimate d of a point is
+within a factor of two of its true distance to the set, so the
+whole disc of radius d/DE_BOUND around it is outside the set, and a
+point r inside the disc is at least d/DE_BOUND - r away.  Its own
+estimate would be at least half that, so where that is still DE_FAR
+pixels the point would be drawn white anyway, and it is filled
+without iterating: iters 0 and a lower bound for its distance.
+Only conformal families with a connected set have such a bound;
+the others are computed in full.
+*/
+
+static void distance_tile( render_job *job, thread_stats *ts, int x0, int y0, int w, int h )
+{
+	const viewport *v = job->v;
+	double start = ts ? now() : 0;
+	long long iters = 0, samples = 0;
+
+	// Unknown pixels are -1: computed ones have at least one iteration, filled ones 0.
+	for (int j = y0; j < y0 + h; j++) {
+		for (int i = x0; i < x0 + w; i++)
+			job->iters[(size_t)j * v->width + i] = -1;
+	}
+
+	for (int j = y0; j < y0 + h; j++) {
+		for (int i = x0; i < x0 + w; i++) {
+			size_t k = (size_t)j * v->width + i;
+			double fi = i, fj = j;
+
+			if (job->iters[k] >= 0)
+				continue;
+
+			sample_points(job, &fi, &fj, 1, &job->iters[k], &job->dist[k]);
+			iters += job->iters[k];
+			samples++;
+			count_escapes(ts, &job->iters[k], 1, v->maxiter);
+
+			double bound = job->dist[k] / DE_BOUND;
+			if (job->fill && job->iters[k] < v->maxiter && bound - 2 * DE_FAR >= 1)
+				fill_disc(job, i, j, bound - 2 * DE_FAR, bound, x0, y0, w, h);
+		}
+	}
+
+	if (job->colors) {
+		for (int j = y0; j < y0 + h; j++) {
+			for (int i = x0; i < x0 + w; i++)
+				job->colors[(size_t)j * v->width + i] = pixel_color(job, (size_t)j * v->width + i);
+		}
+	}
+
+	if (ts) {
+		ts->compute += now() - start;
+		ts->iters += iters;
+		ts->samples += samples;
+	}
+}
+
+/*
+Tile schedule: threads repeatedly take the next unstarted tile
+until none are left.  Tiles on the right and bottom edges are
+clipped to the image.  In distance mode, exterior discs inside a
+tile are filled instead of computed.
+*/
+
+static void compute_tiles( render_job *job, thread_args *thread )
+{
+	thread_stats *ts = thread->stats;
+	int size = job->tile_size;
+	int ntasks = job->tiles_x * job->tiles_y;
+	long long counted[COUNTER_COUNT];
+
+	while (1) {
+		// find available task
+		lock(job, ts);
+		int task = job->next_task;
+		if (task < ntasks)
+			job->next_task++;
+		unlock(job);
+
+		// there is no task to complete
+		if (task >= ntasks)
+			break;
+
+		int xtask = (task % job->tiles_x) * size;
+		int ytask = (task / job->tiles_x) * size;
+		int w = xtask + size < job->v->width ? size : job->v->width - xtask;
+		int h = ytask + size < job->v->height ? size : job->v->height - ytask;
+
+		long long iters = ts ? ts->iters : 0;
+		double traced = trace_start(job, ts);
+		counters_start(job, ts, counted);
+		if (job->pass == PASS_COMPUTE && job->dist) {
+			distance_tile(job, ts, xtask, ytask, w, h);
+		} else {
+			for (int j = ytask; j < ytask + h; j++)
+				do_span(job, ts, j, xtask, xtask + w);
+		}
+		counters_stop(job, ts, counted);
+		trace_stop(job, ts, traced, iters, xtask, ytask, w, h);
+
+		draw_rect(job, ts, xtask, ytask, w, h);
+		if (ts)
+			ts->tiles++;
+	}
+}
+
+/*
+Histogram equalization, on every thread of the job at once.  Each
+thread counts the pixels of each iteration count in its band of
+rows into a histogram of its own, then sums one slice of the bins
+over all the histograms.  Prefix sums of the slices give each count
+its place in the cumulative distribution, which becomes its position
+on the gradient, so the colors are spread evenly over the pixels
+that escaped however the counts are distributed.  Each thread then
+colors and draws its band.  The threads only meet at the barriers
+between these steps, so the whole pass is O(pixels + bins) with no
+lock.  Past EQUALIZE_BINS counts, the high ones share bins, so
+the histograms stay small however deep the view is, and the
+few pixels that escape so late share a color with their neighbors.
+*/
+
+static void equalize( render_job *job, int t, thread_stats *ts )
+{
+	const viewport *v = job->v;
+	int n = job->num_threads;
+	int bins = job->bins;
+	int start = t * v->height / n, end = (t + 1) * v->height / n;
+	int first = t * bins / n, last = (t + 1) * bins / n;
+	unsigned int *partial = job->partial + (size_t)t * bins;
+	double begin = ts ? now() : 0;
+
+	memset(partial, 0, bins * sizeof(unsigned int));
+	for (int j = start; j < end; j++) {
+		const int *row = job->iters + (size_t)j * v->width;
+		for (int i = 0; i < v->width; i++)
+			partial[bin_of(job, row[i])]++;
+	}
+	pthread_barrier_wait(&job->barrier);
+
+	// Points that never escaped stay black and out of the distribution.
+	long sum = 0;
+	for (int b = first; b < last; b++) {
+		unsigned int count = 0;
+		for (int k = 0; k < n; k++)
+			count += job->partial[(size_t)k * bins + b];
+		job->hist[b] = count;
+		if (b < bins - 1)
+			sum += count;
+	}
+	job->slice_sums[t] = sum;
+	pthread_barrier_wait(&job->barrier);
+
+	long below = 0, total = 0;
+	for (int k = 0; k < n; k++) {
+		if (k < t)
+			below += job->slice_sums[k];
+		total += job->slice_sums[k];
+	}
+	// Each count sits at the middle of its share, so no escaped pixel reaches the black end.
+	for (int b = first; b < last && b < bins - 1; b++) {
+		job->cdf[b] = total > 0 ? (below + job->hist[b] / 2.0) / total : 0;
+		below += job->hist[b];
+	}
+	pthread_barrier_wait(&job->barrier);
+
+	for (int j = start; j < end; j++) {
+		unsigned int *colors = job->colors + (size_t)j * v->width;
+		for (int i = 0; i < v->width; i++)
+			colors[i] = pixel_color(job, (size_t)j * v->width + i);
+	}
+	if (ts)
+		ts->compute += now() - begin;
+	trace_stop(job, ts, begin, ts ? ts->iters : 0, 0, start, v->width, end - start);
+
+	if (end > start)
+		draw_rect(job, ts, 0, start, v->width, end - start);
+}
+
+static void *render_thread( void *args )
+{
+	thread_args *thread = (thread_args *)args;
+	render_job *job = thread->job;
+
+	if (job->pass == PASS_EQUALIZE) {
+		equalize(job, thread->thread_id, thread->stats);
+		return NULL;
+	}
+
+	switch (job->o->schedule) {
+		case SCHED_BAND:
+			compute_band(job, thread);
+			break;
+		case SCHED_CYCLIC:
+			compute_cyclic(job, thread);
+			break;
+		case SCHED_TILE:
+			compute_tiles(job, thread);
+			break;
+	}
+
+	return NULL;
+}
+
+/*
+Move the calling worker on or off its own cpu to match the job.
+Workers outlive jobs, so unlike a fresh thread they may have been
+pinned by the last one.
+*/
+
+static void pin_worker( pool_worker *w, int pin )
+{
+	cpu_set_t cpus;
+
+	if (w->pinned == pin)
+		return;
+
+	if (pin) {
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu_order[w->index % num_cpus], &cpus);
+	} else {
+		cpus = allowed_cpus;
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	w->pinned = pin;
+}
+
+static void *pool_worker_main( void *arg )
+{
+	pool_worker *w = (pool_worker *)arg;
+	render_pool *pool = w->pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (1) {
+		while (!w->task && !pool->closing)
+			pthread_cond_wait(&w->wake, &pool->mutex);
+		if (!w->task)
+			break;
+
+		pool_task *task = w->task;
+		pthread_mutex_unlock(&pool->mutex);
+
+		pin_worker(w, task->pin);
+		task->fn(task->arg, task->thread);
+
+		pthread_mutex_lock(&pool->mutex);
+		w->task = NULL;
+		(*task->running)--;
+		pthread_cond_broadcast(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+render_pool *render_pool_create()
+{
+	render_pool *pool = calloc(1, sizeof(render_pool));
+	if (!pool) {
+		perror("calloc");
+		exit(1);
+	}
+
+	if (pthread_mutex_init(&pool->mutex, NULL) || pthread_cond_init(&pool->done, NULL)) {
+		perror("pthread_mutex_init");
+		exit(1);
+	}
+
+	return pool;
+}
+
+/* Start workers until there are n of them.  Called with the pool mutex held. */
+
+static void pool_grow( render_pool *pool, int n )
+{
+	if (n <= pool->num_workers)
+		return;
+
+	pool->workers = realloc(pool->workers, n * sizeof(pool_worker *));
+	if (!pool->workers) {
+		perror("realloc");
+		exit(1);
+	}
+
+	render_default_threads();
+
+	for (int i = pool->num_workers; i < n; i++) {
+		pool_worker *w = calloc(1, sizeof(pool_worker));
+		if (!w) {
+			perror("calloc");
+			exit(1);
+		}
+		w->pool = pool;
+		w->index = i;
+		if (pthread_cond_init(&w->wake, NULL)) {
+			perror("pthread_cond_init");
+			exit(1);
+		}
+		if (pthread_create(&w->thread, NULL, pool_worker_main, w)) {
+			perror("pthread_create");
+			exit(1);
+		}
+		pool->workers[i] = w;
+	}
+	pool->num_workers = n;
+}
+
+void render_pool_free( render_pool *pool )
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->closing = 1;
+	for (int i = 0; i < pool->num_workers; i++)
+		pthread_cond_signal(&pool->workers[i]->wake);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (int i = 0; i < pool->num_workers; i++) {
+		if (pthread_join(pool->workers[i]->thread, NULL)) {
+			perror("pthread_join");
+			exit(1);
+		}
+		pthread_cond_destroy(&pool->workers[i]->wake);
+		free(pool->workers[i]);
+	}
+
+	pthread_cond_destroy(&pool->done);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->workers);
+	free(pool);
+}
+
+/*
+Hand thread i to worker first_worker + i of the pool and wait for
+all of them.  A worker still busy with another caller's task is
+waited for, so two jobs on overlapping workers take turns rather
+than oversubscribing the cpus.
+*/
+
+void render_pool_run( render_pool *pool, int first_worker, int num_threads, int pin, render_pool_fn fn, void *arg )
+{
+	pool_task tasks[num_threads];
+	int running = num_threads;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool_grow(pool, first_worker + num_threads);
+
+	for (int i = 0; i < num_threads; i++) {
+		pool_worker *w = pool->workers[first_worker + i];
+
+		tasks[i].fn = fn;
+		tasks[i].arg = arg;
+		tasks[i].thread = i;
+		tasks[i].pin = pin;
+		tasks[i].running = &running;
+
+		while (w->task)
+			pthread_cond_wait(&pool->done, &pool->mutex);
+		w->task = &tasks[i];
+		pthread_cond_signal(&w->wake);
+	}
+
+	while (running > 0)
+		pthread_cond_wait(&pool->done, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+static void pool_render_thread( void *args, int thread )
+{
+	render_thread(&((thread_args *)args)[thread]);
+}
+
+/* A thread started for one job closes its counters before it exits. */
+
+static void *spawned_render_thread( void *args )
+{
+	render_thread(args);
+	counters_close();
+	return NULL;
+}
+
+/*
+Run the schedule in job->o on its threads, or on the
+calling thread for SCHED_SERIAL.  Threads come from o->pool
+if there is one, and are started for this job otherwise.
+*/
+
+static void run_job( render_job *job )
+{
+	const render_opts *o = job->o;
+	frame_stats *stats = job->stats;
+
+	job->tile_size = o->tile_size > 0 ? o->tile_size : TASK_SIZE;
+	job->tiles_x = (job->v->width + job->tile_size - 1) / job->tile_size;
+	job->tiles_y = (job->v->height + job->tile_size - 1) / job->tile_size;
+	job->next_task = 0;
+
+	if (pthread_mutex_init(&job->mutex, NULL)) { // check if success
+		perror("pthread_mutex_init");
+		exit(1);
+	}
+
+	if (o->schedule == SCHED_SERIAL || o->num_threads < 1) {
+		if (job->pass == PASS_EQUALIZE)
+			equalize(job, 0, stats ? &stats->threads[0] : NULL);
+		else
+			compute_rows(job, stats ? &stats->threads[0] : NULL, 0, job->v->height);
+	} else if (o->pool) {
+		int num_threads = o->num_threads;
+		thread_args args[num_threads];
+
+		for (int i = 0; i < num_threads; i++) {
+			args[i].thread_id = i;
+			args[i].job = job;
+			args[i].stats = stats ? &stats->threads[i] : NULL;
+		}
+
+		render_pool_run(o->pool, o->first_worker, num_threads, o->pin, pool_render_thread, args);
+	} else {
+		int num_threads = o->num_threads;
+		pthread_t threads[num_threads];
+		thread_args args[num_threads];
+		pthread_attr_t attr;
+
+		if (o->pin)
+			render_default_threads();
+
+		for (int i = 0; i < num_threads; i++) {
+			args[i].thread_id = i;
+			args[i].job = job;
+			args[i].stats = stats ? &stats->threads[i] : NULL;
+
+			pthread_attr_init(&attr);
+			if (o->pin) {
+				cpu_set_t cpus;
+				CPU_ZERO(&cpus);
+				CPU_SET(cpu_order[i % num_cpus], &cpus);
+				pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+			}
+
+			if (pthread_create(&threads[i], &attr, spawned_render_thread, &args[i])) {
+				perror("pthread_create");
+				exit(1);
+			}
+			pthread_attr_destroy(&attr);
+		}
+
+		// wait for threads to finish
+		for (int i = 0; i < num_threads; i++) {
+			if (pthread_join(threads[i], NULL)) {
+				perror("pthread_join");
+				exit(1);
+			}
+		}
+	}
+
+	pthread_mutex_destroy(&job->mutex);
+}
+
+/*
+Compute an entire image, writing each point to the given buffer.
+Scale the image to the range (xmin-xmax,ymin-ymax).
+*/
+
+void render_image( const viewport *v, const render_opts *o, int *iters, float *dist, unsigned int *colors, render_draw_t draw, void *arg )
+{
+	render_job job;
+	frame_stats *stats = o->stats;
+	double start = now();
+
+	// Tiles are traced with the iterations the stats count.
+	if (!stats && o->trace)
+		stats = trace_stats(o->trace);
+
+	job.v = v;
+	job.o = o;
+	job.pass = PASS_COMPUTE;
+	job.precision = render_precision(v, o->precision);
+	job.kernel = kernel_get(v->fractal, v->power);
+	job.iters = iters;
+	job.dist = o->distance ? dist : NULL;
+	job.colors = colors;
+	job.draw = colors ? draw : NULL;
+	job.arg = arg;
+	job.stats = stats;
+	job.cdf = NULL;
+
+	// Equalized colors need the whole histogram, so the first pass only computes.
+	int equalizing = colors && o->equalize && !job.dist;
+	if (equalizing) {
+		job.colors = NULL;
+		job.draw = NULL;
+	}
+
+	// The distance kernels have no float version.
+	if (job.dist && job.precision == PREC_FLOAT)
+		job.precision = PREC_DOUBLE;
+
+	// A Julia set is connected when k is in the Multibrot set of the same power.
+	job.fill = o->fill && job.kernel->conformal;
+	if (job.fill && v->fractal == FRACTAL_JULIA)
+		job.fill = kernel_get(FRACTAL_MANDELBROT, v->power)->point(v->kx, v->ky, 0, 0, v->maxiter) == v->maxiter;
+
+	if (stats) {
+		int n = o->schedule == SCHED_SERIAL || o->num_threads < 1 ? 1 : o->num_threads;
+		stats->v = *v;
+		stats->schedule = o->schedule;
+		stats->num_threads = n;
+		stats->precision = job.precision;
+		stats->aa_samples = colors ? o->aa_samples : 0;
+		memset(stats->threads, 0, n * sizeof(thread_stats));
+		for (int i = 0; i < n; i++) {
+			for (int c = 0; c < COUNTER_COUNT; c++)
+				stats->threads[i].counters[c] = o->counters ? 0 : -1;
+		}
+	}
+
+	run_job(&job);
+
+	if (equalizing) {
+		int n = o->schedule == SCHED_SERIAL || o->num_threads < 1 ? 1 : o->num_threads;
+
+		job.exact_bins = v->maxiter;
+		job.bin_step = 1;
+		if (v->maxiter >= EQUALIZE_BINS) {
+			job.exact_bins = EQUALIZE_BINS / 2;
+			job.bin_step = ((long)v->maxiter - job.exact_bins + EQUALIZE_BINS / 2 - 2) / (EQUALIZE_BINS / 2 - 1);
+		}
+		job.bins = job.exact_bins + ((long)v->maxiter - job.exact_bins + job.bin_step - 1) / job.bin_step + 1;
+		int bins = job.bins;
+
+		job.num_threads = n;
+		job.partial = malloc((size_t)n * bins * sizeof(unsigned int));
+		job.hist = malloc(bins * sizeof(unsigned int));
+		job.slice_sums = malloc(n * sizeof(long));
+		job.cdf = malloc(bins * sizeof(float));
+		if (!job.partial || !job.hist || !job.slice_sums || !job.cdf) {
+			perror("malloc");
+			exit(1);
+		}
+		if (pthread_barrier_init(&job.barrier, NULL, n)) {
+			perror("pthread_barrier_init");
+			exit(1);
+		}
+
+		job.colors = colors;
+		job.draw = draw;
+		job.pass = PASS_EQUALIZE;
+		run_job(&job);
+		pthread_barrier_destroy(&job.barrier);
+	}
+
+	// Edges can only be found once every pixel has its first sample.
+	if (colors && o->aa_samples > 0) {
+		job.pass = PASS_ANTIALIAS;
+		run_job(&job);
+	}
+
+	if (equalizing) {
+		free(job.partial);
+		free(job.hist);
+		free(job.slice_sums);
+		free(job.cdf);
+	}
+
+	if (stats) {
+		stats->wall = now() - start;
+		stats->iters = 0;
+		stats->samples = 0;
+		stats->escaped = 0;
+		stats->late = 0;
+		stats->deepest = 0;
+		for (int c = 0; c < COUNTER_COUNT; c++)
+			stats->counters[c] = o->counters ? 0 : -1;
+		for (int i = 0; i < stats->num_threads; i++) {
+			thread_stats *ts = &stats->threads[i];
+			ts->idle = stats->wall - ts->compute - ts->draw - ts->lock_wait;
+			if (ts->idle < 0)
+				ts->idle = 0;
+			stats->iters += ts->iters;
+			stats->samples += ts->samples;
+			stats->escaped += ts->escaped;
+			stats->late += ts->late;
+			if (ts->deepest > stats->deepest)
+				stats->deepest = ts->deepest;
+			for (int c = 0; c < COUNTER_COUNT; c++) {
+				if (ts->counters[c] < 0 || stats->counters[c] < 0)
+					stats->counters[c] = -1;
+				else
+					stats->counters[c] += ts->counters[c];
+			}
+		}
+	}
+
+	if (o->trace)
+		trace_frame(o->trace, stats, start);
+}
+
+/*
+Compute the rectangle on the calling thread with the same arithmetic
+render_image uses, so every pixel matches the whole image exactly.
+*/
+
+void render_rect( const viewport *v, const render_opts *o, int x, int y, int w, int h, int *iters )
+{
+	render_job job;
+	double fi[SPAN_CHUNK], fj[SPAN_CHUNK];
+
+	memset(&job, 0, sizeof(job));
+	job.v = v;
+	job.o = o;
+	job.pass = PASS_COMPUTE;
+	job.precision = render_precision(v, o->precision);
+	job.kernel = kernel_get(v->fractal, v->power);
+
+	for (int j = 0; j < h; j++) {
+		for (int i = 0; i < w; i += SPAN_CHUNK) {
+			int n = w - i < SPAN_CHUNK ? w - i : SPAN_CHUNK;
+			for (int k = 0; k < n; k++) {
+				fi[k] = x + i + k;
+				fj[k] = y + j;
+			}
+			sample_points(&job, fi, fj, n, iters + (size_t)j * w + i, NULL);
+		}
+	}
+}
+
+static int same_layout( const render_opts *a, const render_opts *b )
+{
+	return a->schedule == b->schedule && a->num_threads == b->num_threads &&
+		a->block_rows == b->block_rows && a->tile_size == b->tile_size && a->pin == b->pin &&
+		a->pool == b->pool && a->first_worker == b->first_worker;
+}
+
+/*
+Map fresh, untouched pages for the buffer and have each thread
+zero the rows it will compute.  Tiles have no fixed owner, so for
+SCHED_TILE the rows are spread over the threads a tile row at a time.
+*/
+
+int *render_buffer_get( render_buffer *b, const viewport *v, const render_opts *o )
+{
+	if (b->iters && b->width == v->width && b->height == v->height && same_layout(&b->layout, o))
+		return b->iters;
+
+	render_buffer_free(b);
+
+	b->bytes = (size_t)v->width * v->height * sizeof(int);
+	b->iters = mmap(NULL, b->bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (b->iters == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	b->width = v->width;
+	b->height = v->height;
+	b->layout = *o;
+
+	render_opts touch_opts = *o;
+	if (touch_opts.schedule == SCHED_TILE) {
+		touch_opts.schedule = SCHED_CYCLIC;
+		touch_opts.block_rows = o->tile_size;
+	}
+
+	render_job job;
+	job.v = v;
+	job.o = &touch_opts;
+	job.pass = PASS_TOUCH;
+	job.precision = PREC_DOUBLE;
+	job.kernel = NULL;
+	job.fill = 0;
+	job.iters = b->iters;
+	job.dist = NULL;
+	job.colors = NULL;
+	job.draw = NULL;
+	job.arg = NULL;
+	job.cdf = NULL;
+	job.stats = NULL;
+
+	run_job(&job);
+
+	return b->iters;
+}
+
+void render_buffer_free( render_buffer *b )
+{
+	if (b->iters)
+		munmap(b->iters, b->bytes);
+	b->iters = NULL;
+	free(b->dist);
+	b->dist = NULL;
+	free(b->colors);
+	b->colors = NULL;
+}
+
+static void set_color( unsigned int color )
+{
+	gfx_color(color >> 16, (color >> 8) & 0xff, color & 0xff);
+}
+
+/*
+Plot the finished rectangle on the screen.  A rectangle of one color
+is filled in a single request, and otherwise each row is drawn as
+runs of equal color, which covers the flat exterior bands and the
+interior of the set.
+*/
+
+void render_draw_gfx( const viewport *v, const unsigned int *colors, int x, int y, int w, int h, void *arg )
+{
+	unsigned int first = colors[(size_t)y * v->width + x];
+	int uniform = 1;
+
+	for (int j = y; j < y + h && uniform; j++) {
+		for (int i = x; i < x + w; i++) {
+			if (colors[(size_t)j * v->width + i] != first) {
+				uniform = 0;
+				break;
+			}
+		}
+	}
+
+	if (uniform) {
+		set_color(first);
+		gfx_fill_rect(x, y, w, h);
+		return;
+	}
+
+	unsigned int current = first;
+	set_color(current);
+
+	for (int j = y; j < y + h; j++) {
+		const unsigned int *row = colors + (size_t)j * v->width;
+
+		for (int i = x; i < x + w; ) {
+			unsigned int color = row[i];
+			int end = i + 1;
+			while (end < x + w && row[end] == color)
+				end++;
+
+			if (color != current) {
+				set_color(color);
+				current = color;
+			}
+
+			if (end - i > 1)
+				gfx_span(i, end - 1, j);
+			else
+				gfx_point(i, j);
+			i = end;
+		}
+	}
+}
+
+void render_draw_fb( const viewport *v, const unsigned int *colors, int x, int y, int w, int h, void *arg )
+{
+	gfx_fb_present(x, y, w, h);
+}
+
+/*
+The framebuffer doubles as the color buffer, so the workers color
+straight into the pixels the X server reads.
+*/
+
+unsigned int *render_window_colors( render_buffer *b, int use_fb, render_draw_t *draw )
+{
+	unsigned int *fb = use_fb ? gfx_fb_get(b->width, b->height) : NULL;
+
+	if (fb) {
+		*draw = render_draw_fb;
+		return fb;
+	}
+
+	if (!b->colors) {
+		b->colors = malloc((size_t)b->width * b->height * sizeof(unsigned int));
+		if (!b->colors) {
+			perror("malloc");
+			exit(1);
+		}
+	}
+
+	*draw = render_draw_gfx;
+	return b->colors;
+}
+
+void render_window( const viewport *v, const render_opts *o, render_buffer *b, int use_fb )
+{
+	int *iters = render_buffer_get(b, v, o);
+	render_draw_t draw;
+	unsigned int *colors = render_window_colors(b, use_fb, &draw);
+
+	if (o->distance && !b->dist) {
+		b->dist = malloc((size_t)v->width * v->height * sizeof(float));
+		if (!b->dist) {
+			perror("malloc");
+			exit(1);
+		}
+	}
+
+	render_image(v, o, iters, b->dist, colors, draw, NULL);
+}
@@ -0,0 +1,286 @@
+/*
+render.h - Shared Mandelbrot render engines.
+
+The programs in this directory differ only in how the rows of an
+image are handed out to threads.  Each engine computes the iteration
+count of every pixel into a caller-supplied buffer, colors it, and
+calls back into the program as rows or tiles finish so they can be drawn.
+*/
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stddef.h>
+
+/* Work distribution schedules understood by render_image. */
+#define SCHED_SERIAL 0	/* every pixel on the calling thread */
+#define SCHED_BAND   1	/* one contiguous band of rows per thread */
+#define SCHED_CYCLIC 2	/* blocks of rows dealt round-robin to threads */
+#define SCHED_TILE   3	/* square tiles handed out on demand */
+#define SCHED_COUNT  4
+
+/* Fractal families, each iterating z = f(z) + c for pixel c. */
+#define FRACTAL_MANDELBROT 0	/* z^n + c from z = 0, the Multibrots for n > 2 */
+#define FRACTAL_JULIA      1	/* z^n + k from z = c, for a fixed k */
+#define FRACTAL_SHIP       2	/* (|Re z| + i|Im z|)^n + c, the Burning Ship */
+#define FRACTAL_TRICORN    3	/* conj(z)^n + c */
+#define FRACTAL_COUNT      4
+
+#define MAX_POWER 8
+
+/* The Julia parameter the viewers start with: the Douady rabbit. */
+#define JULIA_KX -0.123
+#define JULIA_KY 0.745
+
+/* Floating point types the kernel can iterate in. */
+#define PREC_AUTO   0	/* the cheapest type that cannot change the image */
+#define PREC_FLOAT  1
+#define PREC_DOUBLE 2
+#define PREC_LONG   3	/* long double */
+#define PREC_COUNT  4
+
+/*
+PREC_AUTO uses float while a pixel spans PREC_FLOAT_ULPS float ulps,
+and double while its rounding error, grown over maxiter iterations,
+stays below 1/PREC_MARGIN of the pixel spacing.
+*/
+#define PREC_FLOAT_ULPS 256
+#define PREC_MARGIN 16
+
+#define BLOCK_ROWS 1
+#define TASK_SIZE 20
+#define MAX_THREADS 1024
+
+#define AA_SAMPLES 8
+#define AA_MAX_SAMPLES 256
+#define AA_THRESHOLD 48
+
+/*
+Automatic depth doubles maxiter while more than 1/AUTO_LATE of the
+escaping pixels take over half of it, and halves it once none take
+over a quarter.  It stays under AUTO_MAX_ITER and over AUTO_MIN_ITER
+times one more than the doublings of magnification from a view
+AUTO_WIDTH wide.
+*/
+#define AUTO_LATE 100
+#define AUTO_MIN_ITER 64
+#define AUTO_WIDTH 4.0
+#define AUTO_MAX_ITER (1 << 20)
+
+/*
+In distance mode, pixels DE_FAR pixels from the set are white, and
+a point's estimate, divided by DE_BOUND, is taken as a safe lower
+bound on its true distance when filling exterior discs.
+*/
+#define DE_FAR 4
+#define DE_BOUND 4
+
+/*
+The region of the complex plane, the image it is sampled into, and
+the fractal drawn there.  Left zero, the fractal is the Mandelbrot set.
+*/
+typedef struct {
+	double xmin;
+	double xmax;
+	double ymin;
+	double ymax;
+	int width;
+	int height;
+	int maxiter;
+	int fractal;	/* FRACTAL_ family */
+	int power;	/* n, 2 to MAX_POWER; 0 means 2 */
+	double kx;	/* the Julia parameter k */
+	double ky;
+} viewport;
+
+/* Hardware events render_opts.counters counts around each tile. */
+#define COUNTER_CYCLES        0
+#define COUNTER_INSTRUCTIONS  1
+#define COUNTER_BRANCH_MISSES 2
+#define COUNTER_LLC_MISSES    3
+#define COUNTER_COUNT         4
+
+/* Where one thread spent a frame, in seconds. */
+typedef struct {
+	double compute;
+	double draw;
+	double lock_wait;	/* waiting for the task counter or the draw lock */
+	double idle;		/* the rest of the frame's wall time */
+	long tiles;		/* rows or tiles this thread took */
+	long long iters;	/* iterations of compute_point summed over its pixels */
+	long long samples;	/* calls to compute_point */
+	long long escaped;	/* pixels of the first pass that escaped before maxiter */
+	long long late;		/* those that took at least half of maxiter */
+	int deepest;		/* the most iterations any of them took */
+	long long counters[COUNTER_COUNT];	/* COUNTER_ events over its tiles, -1 if not counted */
+} thread_stats;
+
+/* Measurements of one call to render_image. */
+typedef struct {
+	viewport v;
+	int schedule;
+	int num_threads;
+	int precision;		/* the type the kernel used, never PREC_AUTO */
+	double wall;
+	long long iters;
+	long long samples;
+	long long escaped;	/* summed over the threads */
+	long long late;
+	int deepest;
+	long long counters[COUNTER_COUNT];	/* summed over the threads, -1 unless all counted it */
+	int aa_samples;
+	thread_stats threads[MAX_THREADS];
+} frame_stats;
+
+/*
+Worker threads kept from frame to frame, so a job does not pay for
+starting its threads, and two jobs can share the cpus by taking
+different workers.  The pool starts workers as jobs ask for them.
+*/
+typedef struct render_pool render_pool;
+
+/* A record of when each tile was computed and by which thread, see trace.h. */
+typedef struct render_trace render_trace;
+
+/* How the work for one image is split between threads. */
+typedef struct {
+	int schedule;
+	int num_threads;
+	int block_rows;	/* rows per block for SCHED_CYCLIC */
+	int tile_size;	/* edge of a tile for SCHED_TILE */
+	int pin;	/* pin thread i to the i'th cpu in topology order */
+	int precision;	/* PREC_AUTO or the type to force */
+	int aa_samples;		/* extra samples for pixels on an edge, 0 for none, at most AA_MAX_SAMPLES */
+	int aa_threshold;	/* summed RGB difference to a neighbour that makes an edge */
+	int distance;		/* color by the estimated distance to the set */
+	int fill;		/* with distance, let SCHED_TILE fill exterior discs without iterating */
+	int equalize;		/* spread the gradient evenly over the pixels by their histogram */
+	int counters;		/* count COUNTER_ events around each tile into stats */
+	frame_stats *stats;	/* if set, filled in by render_image */
+	render_trace *trace;	/* if set, each tile's thread and times are recorded there */
+	render_pool *pool;	/* if set, run the threads on its workers */
+	int first_worker;	/* thread i runs on worker first_worker + i */
+} render_opts;
+
+/*
+An iteration buffer that is kept between frames.  Its pages are
+first touched by the thread that will write them, so on NUMA hosts
+each band of rows lives on the node of the core that computes it.
+*/
+typedef struct {
+	int *iters;
+	float *dist;		/* for distance mode */
+	unsigned int *colors;	/* for drawing without a framebuffer */
+	size_t bytes;
+	int width;
+	int height;
+	render_opts layout;
+} render_buffer;
+
+/*
+Called when the w x h rectangle at x,y of the color buffer is done.
+Calls are serialized by the engine, so the callback may use gfx directly.
+*/
+typedef void (*render_draw_t)( const viewport *v, const unsigned int *colors, int x, int y, int w, int h, void *arg );
+
+/* Fill in the default options for the given schedule. */
+void render_opts_init( render_opts *o, int schedule, int num_threads );
+
+/* Return the number of cpus this process may run on, a good default thread count. */
+int render_default_threads();
+
+/* Create and free a pool of worker threads. */
+render_pool *render_pool_create();
+void render_pool_free( render_pool *pool );
+
+/*
+Call fn(arg, i) for i from 0 to num_threads - 1, on workers
+first_worker + i of the pool, pinned to their own cpus if pin is
+set, and return when every call has.
+*/
+typedef void (*render_pool_fn)( void *arg, int thread );
+void render_pool_run( render_pool *pool, int first_worker, int num_threads, int pin, render_pool_fn fn, void *arg );
+
+/* Return a buffer for v laid out for o, reallocating it if either changed. */
+int *render_buffer_get( render_buffer *b, const viewport *v, const render_opts *o );
+void render_buffer_free( render_buffer *b );
+
+/*
+Return the maxiter to use for the frame after the one s measured:
+more while the boundary is unresolved, less when nothing escapes late.
+*/
+int render_auto_maxiter( const frame_stats *s );
+
+/* Compute the number of iterations of the Mandelbrot set at point x, y, up to max. */
+int compute_point( double x, double y, int max );
+int compute_point_long( long double x, long double y, int max );
+
+/* The same, also estimating the distance from x, y to the set, or 0 if it never escaped. */
+int compute_point_distance( double x, double y, int max, double *distance );
+int compute_point_distance_long( long double x, long double y, int max, double *distance );
+
+/* Resolve PREC_AUTO to the cheapest precision that is exact enough for v. */
+int render_precision( const viewport *v, int precision );
+
+/* Convert a position t in [0,1) along the gradient to an RGB color. */
+void color_gradient( double t, int *r, int *g, int *b );
+
+/* Convert an iteration count to an RGB color. */
+void color_point( int iter, int maxiter, int *r, int *g, int *b );
+
+/* Convert a distance to the set, in pixels, to an RGB color. */
+void color_distance( double distance, int *r, int *g, int *b );
+
+/*
+Compute every pixel of v into iters (width*height ints, row major).
+If colors is not NULL, also write each pixel's 0x00RRGGBB color there
+and call draw as rows or tiles finish.  With o->aa_samples, a second
+pass supersamples the pixels on edges and draws them again.
+
+With o->distance, dist (width*height floats) receives each pixel's
+distance to the set in pixels, and colors the image.  SCHED_TILE then
+skips pixels certain to be white, leaving 0 iterations and a lower
+bound on their distance, unless o->fill is 0.
+
+With o->equalize, and not o->distance, the colors come from the
+histogram of the finished image instead, in a pass of their own
+that draws each thread's band of rows once it is colored.
+*/
+void render_image( const viewport *v, const render_opts *o, int *iters, float *dist, unsigned int *colors, render_draw_t draw, void *arg );
+
+/*
+Compute only the w x h rectangle at x,y of v, on the calling thread,
+into iters (w*h ints, row major).  Each pixel gets exactly the count
+render_image gives it; o->precision is the only option used.
+*/
+void render_rect( const viewport *v, const render_opts *o, int x, int y, int w, int h, int *iters );
+
+/* Render v into the gfx window, through the framebuffer if use_fb and the display allow it. */
+void render_window( const viewport *v, const render_opts *o, render_buffer *b, int use_fb );
+
+/*
+Return the color buffer behind the window for b's size: the framebuffer
+if use_fb and the display allow it, or b->colors.  Set draw to the
+render_draw_t that shows a rectangle of it.
+*/
+unsigned int *render_window_colors( render_buffer *b, int use_fb, render_draw_t *draw );
+
+/* A render_draw_t that plots the finished rectangle with gfx. */
+void render_draw_gfx( const viewport *v, const unsigned int *colors, int x, int y, int w, int h, void *arg );
+
+/* A render_draw_t for colors that are the gfx framebuffer: present the rectangle. */
+void render_draw_fb( const viewport *v, const unsigned int *colors, int x, int y, int w, int h, void *arg );
+
+/* Convert between schedule numbers and their names. */
+const char *schedule_name( int schedule );
+int schedule_parse( const char *name );
+
+/* Convert between fractal family numbers and their names. */
+const char *fractal_name( int fractal );
+int fractal_parse( const char *name );
+
+/* Convert between precision numbers and their names. */
+const char *precision_name( int precision );
+int precision_parse( const char *name );
+
+#endif
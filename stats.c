@@ -0,0 +1,187 @@
+/*
+stats.c - Report the frame_stats filled in by render_image.
+See stats.h for the interface.
+*/
+
+#include "stats.h"
+#include "gfx.h"
+#include "counters.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BAR_HEIGHT 4
+#define BAR_GAP 1
+
+static double miters_per_second( const frame_stats *s )
+{
+	return s->wall > 0 ? s->iters / s->wall / 1e6 : 0;
+}
+
+/* Return whether any hardware counter was read for the frame. */
+
+static int counted( const frame_stats *s )
+{
+	for (int c = 0; c < COUNTER_COUNT; c++) {
+		if (s->counters[c] >= 0)
+			return 1;
+	}
+	return 0;
+}
+
+static int power_of( const viewport *v )
+{
+	return v->power ? v->power : 2;
+}
+
+void stats_log_open( stats_output *out, const char *path )
+{
+	size_t len = strlen(path);
+
+	out->log = fopen(path, "w");
+	if (!out->log) {
+		perror(path);
+		exit(1);
+	}
+	out->json = len > 5 && !strcmp(path + len - 5, ".json");
+
+	if (!out->json)
+		fprintf(out->log, "frame,schedule,threads,fractal,power,width,height,maxiter,precision,aa_samples,wall_s,miter_s,samples,thread,compute_s,draw_s,lock_wait_s,idle_s,tiles,iters,thread_samples,cycles,instructions,branch_misses,llc_misses\n");
+}
+
+void stats_log_close( stats_output *out )
+{
+	if (out->log)
+		fclose(out->log);
+	out->log = NULL;
+}
+
+void stats_print( FILE *file, const frame_stats *s )
+{
+	long long pixels = (long long)s->v.width * s->v.height;
+
+	fprintf(file, "frame: %s %d threads %s^%d %dx%d maxiter %d %s: %.4fs %.1f Miter/s, %lld samples (%.2f per pixel)\n",
+		schedule_name(s->schedule), s->num_threads, fractal_name(s->v.fractal), power_of(&s->v),
+		s->v.width, s->v.height, s->v.maxiter, precision_name(s->precision), s->wall, miters_per_second(s), s->samples, pixels ? (double)s->samples / pixels : 0);
+
+	for (int i = 0; i < s->num_threads; i++) {
+		const thread_stats *ts = &s->threads[i];
+		fprintf(file, "  thread %d: compute %.4fs draw %.4fs lock %.4fs idle %.4fs, %ld tiles, %lld iters, %lld samples\n",
+			i, ts->compute, ts->draw, ts->lock_wait, ts->idle, ts->tiles, ts->iters, ts->samples);
+	}
+
+	// Counters that were not available are left out, and the ratios that need them.
+	if (counted(s)) {
+		const long long *c = s->counters;
+		fprintf(file, "  counters:");
+		for (int i = 0; i < COUNTER_COUNT; i++) {
+			if (c[i] >= 0)
+				fprintf(file, " %s %lld", counter_name(i), c[i]);
+		}
+		if (c[COUNTER_CYCLES] > 0 && c[COUNTER_INSTRUCTIONS] >= 0)
+			fprintf(file, ", %.2f IPC", (double)c[COUNTER_INSTRUCTIONS] / c[COUNTER_CYCLES]);
+		if (c[COUNTER_CYCLES] >= 0 && s->iters > 0)
+			fprintf(file, ", %.2f cycles/iter", (double)c[COUNTER_CYCLES] / s->iters);
+		fprintf(file, "\n");
+	}
+}
+
+/* One CSV row per thread, repeating the frame columns. */
+
+static void log_csv( FILE *file, long frame, const frame_stats *s )
+{
+	for (int i = 0; i < s->num_threads; i++) {
+		const thread_stats *ts = &s->threads[i];
+		fprintf(file, "%ld,%s,%d,%s,%d,%d,%d,%d,%s,%d,%.6f,%.3f,%lld,%d,%.6f,%.6f,%.6f,%.6f,%ld,%lld,%lld,%lld,%lld,%lld,%lld\n",
+			frame, schedule_name(s->schedule), s->num_threads, fractal_name(s->v.fractal), power_of(&s->v), s->v.width, s->v.height, s->v.maxiter, precision_name(s->precision), s->aa_samples,
+			s->wall, miters_per_second(s), s->samples, i, ts->compute, ts->draw, ts->lock_wait, ts->idle, ts->tiles, ts->iters, ts->samples,
+			ts->counters[COUNTER_CYCLES], ts->counters[COUNTER_INSTRUCTIONS], ts->counters[COUNTER_BRANCH_MISSES], ts->counters[COUNTER_LLC_MISSES]);
+	}
+}
+
+/* One JSON object per line and frame. */
+
+static void log_json( FILE *file, long frame, const frame_stats *s )
+{
+	fprintf(file, "{\"frame\":%ld,\"schedule\":\"%s\",\"threads\":%d,\"fractal\":\"%s\",\"power\":%d,\"k\":[%.17g,%.17g],\"width\":%d,\"height\":%d,\"maxiter\":%d,\"precision\":\"%s\",\"aa_samples\":%d,"
+		"\"viewport\":[%.17g,%.17g,%.17g,%.17g],\"wall_s\":%.6f,\"iters\":%lld,\"miter_s\":%.3f,\"samples\":%lld,\"per_thread\":[",
+		frame, schedule_name(s->schedule), s->num_threads, fractal_name(s->v.fractal), power_of(&s->v), s->v.kx, s->v.ky, s->v.width, s->v.height, s->v.maxiter, precision_name(s->precision), s->aa_samples,
+		s->v.xmin, s->v.xmax, s->v.ymin, s->v.ymax, s->wall, s->iters, miters_per_second(s), s->samples);
+
+	for (int i = 0; i < s->num_threads; i++) {
+		const thread_stats *ts = &s->threads[i];
+		fprintf(file, "%s{\"compute_s\":%.6f,\"draw_s\":%.6f,\"lock_wait_s\":%.6f,\"idle_s\":%.6f,\"tiles\":%ld,\"iters\":%lld,\"samples\":%lld",
+			i ? "," : "", ts->compute, ts->draw, ts->lock_wait, ts->idle, ts->tiles, ts->iters, ts->samples);
+		for (int c = 0; c < COUNTER_COUNT; c++) {
+			if (ts->counters[c] >= 0)
+				fprintf(file, ",\"%s\":%lld", counter_name(c), ts->counters[c]);
+		}
+		fprintf(file, "}");
+	}
+
+	fprintf(file, "]}\n");
+}
+
+/* Draw a w pixel wide, BAR_HEIGHT tall segment at x,y. */
+
+static void bar( int x, int y, int w )
+{
+	gfx_fill_rect(x, y, w, BAR_HEIGHT);
+}
+
+/*
+The full window width stands for the frame's wall time.  Each bar
+shows compute in green, draw in blue, lock wait in red and idle in grey.
+*/
+
+void stats_overlay( const frame_stats *s )
+{
+	int width = gfx_xsize();
+	int y = gfx_ysize() - s->num_threads * (BAR_HEIGHT + BAR_GAP);
+
+	if (s->wall <= 0)
+		return;
+
+	for (int i = 0; i < s->num_threads; i++, y += BAR_HEIGHT + BAR_GAP) {
+		const thread_stats *ts = &s->threads[i];
+		int compute = ts->compute / s->wall * width;
+		int draw = ts->draw / s->wall * width;
+		int lock = ts->lock_wait / s->wall * width;
+		int x = 0;
+
+		if (y < 0)
+			continue;
+
+		gfx_color(0, 200, 0);
+		bar(x, y, compute);
+		x += compute;
+		gfx_color(0, 100, 255);
+		bar(x, y, draw);
+		x += draw;
+		gfx_color(255, 0, 0);
+		bar(x, y, lock);
+		x += lock;
+		gfx_color(128, 128, 128);
+		bar(x, y, width - x);
+	}
+}
+
+void stats_report( stats_output *out, const frame_stats *s )
+{
+	if (out->verbose)
+		stats_print(stderr, s);
+
+	if (out->log) {
+		if (out->json)
+			log_json(out->log, out->frames, s);
+		else
+			log_csv(out->log, out->frames, s);
+		fflush(out->log);
+	}
+
+	if (out->overlay)
+		stats_overlay(s);
+
+	out->frames++;
+}
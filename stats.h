@@ -0,0 +1,37 @@
+/*
+stats.h - Report the frame_stats filled in by render_image.
+
+Each frame can be summarized on stderr, appended to a CSV or
+JSON Lines log, and drawn as per-thread bars over the image.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "render.h"
+
+#include <stdio.h>
+
+/* Where the stats of each frame go. */
+typedef struct {
+	int verbose;	/* print a summary of each frame to stderr */
+	int overlay;	/* draw a bar per thread over the image */
+	FILE *log;	/* CSV or JSON log, or NULL */
+	int json;
+	long frames;
+} stats_output;
+
+/* Open a log file: JSON Lines if path ends in ".json", CSV otherwise. */
+void stats_log_open( stats_output *out, const char *path );
+void stats_log_close( stats_output *out );
+
+/* Print, log and draw the stats of one frame as out asks. */
+void stats_report( stats_output *out, const frame_stats *s );
+
+/* Print a summary of one frame to the given file. */
+void stats_print( FILE *file, const frame_stats *s );
+
+/* Draw one bar per thread along the bottom of the window. */
+void stats_overlay( const frame_stats *s );
+
+#endif
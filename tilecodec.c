@@ -0,0 +1,154 @@
+/*
+tilecodec.c - Compact encoding of a tile's iteration counts.
+See tilecodec.h for the format.
+*/
+
+#include "tilecodec.h"
+
+#include <stdint.h>
+
+int tile_bits( int maxiter )
+{
+	int bits = 1;
+	while (bits < 31 && (maxiter >> bits) > 0)
+		bits++;
+	return bits;
+}
+
+/*
+A literal costs at most 5 bytes of length and one of padding beyond
+its packed counts, a run at most 10 bytes, and every literal but the
+last is ended by a run of at least TILE_RUN_MIN counts.
+*/
+
+size_t tile_encode_bound( int n, int maxiter )
+{
+	return ((size_t)n * tile_bits(maxiter) + 7) / 8 + ((size_t)n / TILE_RUN_MIN + 1) * 16;
+}
+
+static unsigned char *put_number( unsigned char *out, uint32_t value )
+{
+	while (value >= 0x80) {
+		*out++ = value | 0x80;
+		value >>= 7;
+	}
+	*out++ = value;
+	return out;
+}
+
+static const unsigned char *get_number( const unsigned char *in, const unsigned char *end, uint32_t *value )
+{
+	uint32_t v = 0;
+
+	for (int shift = 0; shift < 35 && in < end; shift += 7) {
+		unsigned char byte = *in++;
+		v |= (uint32_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			*value = v;
+			return in;
+		}
+	}
+	return NULL;
+}
+
+static unsigned char *put_literal( unsigned char *out, const int *iters, int n, int bits )
+{
+	uint64_t acc = 0;
+	int filled = 0;
+
+	out = put_number(out, (uint32_t)n << 1);
+
+	for (int i = 0; i < n; i++) {
+		acc |= (uint64_t)(uint32_t)iters[i] << filled;
+		filled += bits;
+		if (filled >= 32) {
+			out[0] = acc;
+			out[1] = acc >> 8;
+			out[2] = acc >> 16;
+			out[3] = acc >> 24;
+			out += 4;
+			acc >>= 32;
+			filled -= 32;
+		}
+	}
+
+	for (; filled > 0; filled -= 8) {
+		*out++ = acc;
+		acc >>= 8;
+	}
+	return out;
+}
+
+size_t tile_encode( const int *iters, int n, int maxiter, unsigned char *out )
+{
+	int bits = tile_bits(maxiter);
+	unsigned char *start = out;
+	int literal = 0;	// where the counts not yet written start
+	int i = 0;
+
+	while (i < n) {
+		int j = i + 1;
+		while (j < n && iters[j] == iters[i])
+			j++;
+
+		if (j - i >= TILE_RUN_MIN) {
+			if (literal < i)
+				out = put_literal(out, iters + literal, i - literal, bits);
+			out = put_number(out, (uint32_t)(j - i) << 1 | 1);
+			out = put_number(out, iters[i]);
+			literal = j;
+		}
+		i = j;
+	}
+
+	if (literal < n)
+		out = put_literal(out, iters + literal, n - literal, bits);
+
+	return out - start;
+}
+
+int tile_decode( const unsigned char *in, size_t size, int maxiter, int *iters, int n )
+{
+	const unsigned char *end = in + size;
+	int bits = tile_bits(maxiter);
+	uint32_t mask = bits < 32 ? (1u << bits) - 1 : 0xffffffffu;
+	int i = 0;
+
+	while (in < end) {
+		uint32_t head, count;
+		if (!(in = get_number(in, end, &head)))
+			return -1;
+		count = head >> 1;
+		if (count == 0 || count > (uint32_t)(n - i))
+			return -1;
+
+		if (head & 1) {
+			uint32_t value;
+			if (!(in = get_number(in, end, &value)) || value > (uint32_t)maxiter)
+				return -1;
+			for (uint32_t k = 0; k < count; k++)
+				iters[i++] = value;
+			continue;
+		}
+
+		if ((size_t)(end - in) < ((size_t)count * bits + 7) / 8)
+			return -1;
+
+		uint64_t acc = 0;
+		int filled = 0;
+		for (uint32_t k = 0; k < count; k++) {
+			while (filled < bits) {
+				acc |= (uint64_t)*in++ << filled;
+				filled += 8;
+			}
+			uint32_t value = acc & mask;
+			if (value > (uint32_t)maxiter)
+				return -1;
+			iters[i++] = value;
+			acc >>= bits;
+			filled -= bits;
+		}
+	}
+
+	return i == n ? 0 : -1;
+}
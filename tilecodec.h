@@ -0,0 +1,42 @@
+/*
+tilecodec.h - Compact encoding of a tile's iteration counts.
+
+Counts lie between 0 and maxiter, so each needs only as many bits as
+maxiter does, and the inside of the set and the flat bands around it
+are long runs of one count.  An encoded tile is a series of segments,
+each starting with a LEB128 number holding its length n shifted left
+one bit, with the low bit telling which kind it is:
+
+	0	a literal: n counts packed tile_bits(maxiter) bits each,
+		least significant bit first, padded to a whole byte
+	1	a run: n copies of one count, which follows as a LEB128 number
+
+Runs shorter than TILE_RUN_MIN are left in the literals around them.
+The encoding has no header, so the decoder must be told maxiter and
+the number of counts.
+*/
+
+#ifndef TILECODEC_H
+#define TILECODEC_H
+
+#include <stddef.h>
+
+#define TILE_RUN_MIN 8
+
+/* The bits each count takes for counts up to maxiter. */
+int tile_bits( int maxiter );
+
+/* The most bytes tile_encode can write for n counts up to maxiter. */
+size_t tile_encode_bound( int n, int maxiter );
+
+/* Encode the n counts at iters, each 0 to maxiter, into out.  Return the bytes written. */
+size_t tile_encode( const int *iters, int n, int maxiter, unsigned char *out );
+
+/*
+Decode size bytes at in into n counts at iters.  Return 0, or -1 if
+the bytes do not hold exactly n counts up to maxiter, which may leave
+iters partly written.
+*/
+int tile_decode( const unsigned char *in, size_t size, int maxiter, int *iters, int n );
+
+#endif
@@ -0,0 +1,176 @@
+/*
+trace.c - Record when each tile of a frame was computed, and by whom.
+See trace.h for the interface.
+*/
+
+#define _GNU_SOURCE
+
+#include "trace.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+	double start;
+	double end;
+	const char *name;
+	int x, y, w, h;
+	long long iters;
+} trace_event;
+
+/*
+One thread's events.  written only grows, so event k is at
+k % TRACE_RING until TRACE_RING more overwrite it.
+*/
+typedef struct {
+	trace_event *events;	// allocated by the thread on its first event
+	unsigned long written;
+	unsigned long dumped;	// events already in the file, or overwritten before they got there
+} trace_ring;
+
+struct render_trace {
+	FILE *file;
+	double origin;		// the time 0 of the file
+	long frames;
+	int first;		// nothing is in the file yet
+	int named;		// the threads with a name in the file
+	frame_stats stats;
+	trace_ring rings[MAX_THREADS];
+};
+
+// The frames have the track before the threads.
+#define FRAME_TID 0
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double micros( const render_trace *t, double when )
+{
+	return (when - t->origin) * 1e6;
+}
+
+/* Start the next object of the array. */
+
+static void separate( render_trace *t )
+{
+	fprintf(t->file, t->first ? "\n" : ",\n");
+	t->first = 0;
+}
+
+static void name_track( render_trace *t, int tid, const char *kind, int index )
+{
+	separate(t);
+	fprintf(t->file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s", (int)getpid(), tid, kind);
+	if (index >= 0)
+		fprintf(t->file, " %d", index);
+	fprintf(t->file, "\"}}");
+}
+
+render_trace *trace_open( const char *path )
+{
+	render_trace *t = calloc(1, sizeof(render_trace));
+	if (!t) {
+		perror("calloc");
+		exit(1);
+	}
+
+	t->file = fopen(path, "w");
+	if (!t->file) {
+		perror(path);
+		exit(1);
+	}
+	t->origin = now();
+	t->first = 1;
+
+	fprintf(t->file, "[");
+	name_track(t, FRAME_TID, "frames", -1);
+	return t;
+}
+
+void trace_close( render_trace *t )
+{
+	if (!t)
+		return;
+
+	fprintf(t->file, "\n]\n");
+	fclose(t->file);
+	for (int i = 0; i < MAX_THREADS; i++)
+		free(t->rings[i].events);
+	free(t);
+}
+
+frame_stats *trace_stats( render_trace *t )
+{
+	return &t->stats;
+}
+
+void trace_record( render_trace *t, int thread, const char *name, int x, int y, int w, int h, double start, double end, long long iters )
+{
+	trace_ring *r = &t->rings[thread];
+
+	if (!r->events) {
+		r->events = malloc(TRACE_RING * sizeof(trace_event));
+		if (!r->events) {
+			perror("malloc");
+			exit(1);
+		}
+	}
+
+	trace_event *e = &r->events[r->written % TRACE_RING];
+	e->start = start;
+	e->end = end;
+	e->name = name;
+	e->x = x;
+	e->y = y;
+	e->w = w;
+	e->h = h;
+	e->iters = iters;
+	r->written++;
+}
+
+/*
+Each thread's events go on its own track, named the first time it
+appears, and the frame as a whole on the frames track, with the
+events lost to a full ring in its args.
+*/
+
+void trace_frame( render_trace *t, const frame_stats *s, double start )
+{
+	int pid = getpid();
+	unsigned long dropped = 0;
+
+	for (; t->named < s->num_threads; t->named++)
+		name_track(t, FRAME_TID + 1 + t->named, "thread", t->named);
+
+	for (int i = 0; i < s->num_threads; i++) {
+		trace_ring *r = &t->rings[i];
+
+		if (r->written - r->dumped > TRACE_RING) {
+			dropped += r->written - r->dumped - TRACE_RING;
+			r->dumped = r->written - TRACE_RING;
+		}
+		for (; r->dumped < r->written; r->dumped++) {
+			const trace_event *e = &r->events[r->dumped % TRACE_RING];
+			separate(t);
+			fprintf(t->file, "{\"name\":\"%s\",\"cat\":\"tile\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+				"\"args\":{\"frame\":%ld,\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d,\"iters\":%lld}}",
+				e->name, pid, FRAME_TID + 1 + i, micros(t, e->start), (e->end - e->start) * 1e6,
+				t->frames, e->x, e->y, e->w, e->h, e->iters);
+		}
+	}
+
+	separate(t);
+	fprintf(t->file, "{\"name\":\"frame %ld\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+		"\"args\":{\"frame\":%ld,\"schedule\":\"%s\",\"threads\":%d,\"width\":%d,\"height\":%d,\"maxiter\":%d,\"precision\":\"%s\",\"iters\":%lld,\"dropped\":%lu}}",
+		t->frames, pid, FRAME_TID, micros(t, start), s->wall * 1e6,
+		t->frames, schedule_name(s->schedule), s->num_threads, s->v.width, s->v.height, s->v.maxiter, precision_name(s->precision), s->iters, dropped);
+	fflush(t->file);
+
+	t->frames++;
+}
@@ -0,0 +1,39 @@
+/*
+trace.h - Record when each tile of a frame was computed, and by whom.
+
+With render_opts.trace set, every thread notes the start and end
+of each row or tile it computes, its place in the image and the
+iterations it took, in a ring of its own.  A ring has one writer and
+is only read once render_image has waited for every thread, so
+recording takes no lock and no atomic operation.  After each frame
+the new events are appended to the trace file in the Chrome trace
+event format, which chrome://tracing and ui.perfetto.dev load, one
+track per thread under a track of frames.  The file stays loadable
+while the program runs, as both accept an array left unclosed.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "render.h"
+
+#define TRACE_RING 16384	/* events each thread keeps per frame, the oldest overwritten */
+
+/* Create a trace writing to path, and close it, finishing the file. */
+render_trace *trace_open( const char *path );
+void trace_close( render_trace *t );
+
+/*
+Note that thread spent start..end, in seconds on the monotonic
+clock, on the w x h rectangle at x,y, during the pass called name.
+Only that thread may record for it while a frame renders.
+*/
+void trace_record( render_trace *t, int thread, const char *name, int x, int y, int w, int h, double start, double end, long long iters );
+
+/* Append the events of the frame s measured, which began at start, to the file. */
+void trace_frame( render_trace *t, const frame_stats *s, double start );
+
+/* Stats for render_image to fill when the caller's options have none. */
+frame_stats *trace_stats( render_trace *t );
+
+#endif